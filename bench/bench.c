@@ -0,0 +1,577 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "./third_party/noise.h"
+#include "config.h"
+#include "map.h"
+#include "chunk_map.h"
+#include "region.h"
+#include "world.h"
+#include "sky.h"
+#include "cloud.h"
+#include "mesh.h"
+#include "profile.h"
+#include "chunk_index.h"
+#include "item.h"
+
+// Generates and meshes every chunk within a radius of the origin on one
+// thread, the same steps the game runs on its workers, and reports the
+// throughput and latency of both.
+//
+//   mycraft_bench [-r radius] [-s seed] [-p trace.json] [-a] [-i] [-g] [-x]
+//
+// -p records the profiler zones and writes them as a Chrome trace.
+// -a also times the block reads of meshing, collide and _hit_test on the
+// ChunkMaps against the same blocks in the hashed Map they replaced.
+// -i times find_chunk lookups in a ChunkIndex holding radius 3 and 30,
+// against the linear scan of the chunk list it replaced.
+// -g meshes every snapshot again with both compute_chunk and
+// compute_chunk_greedy and reports the faces, vertices and build time of
+// each.
+// -x times count_faces and both meshers on synthetic chunks: solid
+// ground, a checkerboard with every face exposed and noise carved caves.
+
+typedef struct {
+    int p;
+    int q;
+    ChunkMap map;
+    Map lights;
+    SkyMap sky;
+    Mesh clouds;
+} BenchChunk;
+
+typedef struct {
+    double *times;
+    int count;
+    double total;
+} Timings;
+
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int double_cmp(const void *a, const void *b) {
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static double percentile(Timings *timings, int p) {
+    return timings->times[(timings->count - 1) * p / 100];
+}
+
+static void report(const char *name, Timings *timings) {
+    qsort(timings->times, timings->count, sizeof(double), double_cmp);
+    printf("%-5s %6d chunks %9.1f ms %9.1f chunks/s   p50 %6.3f  p90 %6.3f  p99 %6.3f  max %6.3f ms\n",
+	   name, timings->count, timings->total, timings->count * 1e3 / timings->total,
+	   percentile(timings, 50), percentile(timings, 90), percentile(timings, 99),
+	   timings->times[timings->count - 1]);
+}
+
+static void generate(BenchChunk *chunk) {
+    int dx = chunk->p * CHUNK_SIZE;
+    int dz = chunk->q * CHUNK_SIZE;
+    chunk_map_alloc(&chunk->map, dx, dz);
+    create_world(chunk->p, chunk->q, &chunk->map);
+    map_alloc(&chunk->lights, dx - 1, 0, dz - 1, 0xf);
+    sky_alloc(&chunk->sky, dx, dz);
+    sky_compute(&chunk->sky, &chunk->map);
+    if(SHOW_CLOUDS) {
+	unsigned char depth[CLOUD_SIZE * CLOUD_SIZE];
+	cloud_field(depth, chunk->p, chunk->q);
+	cloud_mesh(&chunk->clouds, depth);
+    }
+}
+
+typedef void (*mesh_func)(MeshContext *ctx, Mesh *mesh, ChunkMap *map, Map *lights, SkyMap *sky, int y0, int y1);
+
+typedef struct {
+    const char *name;
+    mesh_func func;
+    Timings timings;
+    long faces;
+} MeshAlgorithm;
+
+// The sections of the snapshot one at a time, as mesh_chunk does
+static void mesh_with(MeshAlgorithm *algorithm, MeshContext *ctx, ChunkMap *map, Map *lights, SkyMap *sky) {
+    double start = now();
+    Mesh meshes[CHUNK_SECTIONS];
+    memset(meshes, 0, sizeof(meshes));
+    for(int i = 0; i < CHUNK_SECTIONS && i * SECTION_HEIGHT < map->top; i++) {
+	algorithm->func(ctx, meshes + i, map, lights, sky, i * SECTION_HEIGHT, (i + 1) * SECTION_HEIGHT);
+    }
+    double elapsed = now() - start;
+    algorithm->timings.times[algorithm->timings.count++] = elapsed;
+    algorithm->timings.total += elapsed;
+    for(int i = 0; i < CHUNK_SECTIONS; i++) {
+	algorithm->faces += meshes[i].faces;
+	mesh_free(meshes + i);
+    }
+}
+
+#define SYNTHETIC_KINDS 3
+#define SYNTHETIC_RUNS 20
+
+static const char *synthetic_names[SYNTHETIC_KINDS] = {"solid", "checker", "caves"};
+
+static int synthetic_block(int kind, int x, int y, int z) {
+    if(kind == 0) {
+	return y < 128 ? STONE : 0;
+    }
+    if(kind == 1) {
+	return y < 64 && ((x + y + z) & 1) ? STONE : 0;
+    }
+    if(y >= 128) {
+	return 0;
+    }
+    return simplex3(x * 0.04, y * 0.06, z * 0.04, 3, 0.5, 2) < 0.55 ? STONE : 0;
+}
+
+// Meshes the middle one of 3x3 synthetic chunks, so that its sides are
+// covered by neighbors like in the world
+static void bench_synthetic(MeshContext *ctx) {
+    for(int kind = 0; kind < SYNTHETIC_KINDS; kind++) {
+	ChunkMap maps[3][3];
+	Map lights[3][3];
+	SkyMap skies[3][3];
+	ChunkMap *block_maps[3][3];
+	Map *light_maps[3][3];
+	SkyMap *sky_maps[3][3];
+	for(int a = 0; a < 3; a++) {
+	    for(int b = 0; b < 3; b++) {
+		int dx = (a - 1) * CHUNK_SIZE;
+		int dz = (b - 1) * CHUNK_SIZE;
+		chunk_map_alloc(&maps[a][b], dx, dz);
+		for(int x = dx; x < dx + CHUNK_SIZE; x++) {
+		    for(int z = dz; z < dz + CHUNK_SIZE; z++) {
+			for(int y = 0; y < 128; y++) {
+			    int w = synthetic_block(kind, x, y, z);
+			    if(w) {
+				chunk_map_set(&maps[a][b], x, y, z, w);
+			    }
+			}
+		    }
+		}
+		map_alloc(&lights[a][b], dx - 1, 0, dz - 1, 0xf);
+		sky_alloc(&skies[a][b], dx, dz);
+		sky_compute(&skies[a][b], &maps[a][b]);
+		block_maps[a][b] = &maps[a][b];
+		light_maps[a][b] = &lights[a][b];
+		sky_maps[a][b] = &skies[a][b];
+	    }
+	}
+	ChunkMap map;
+	Map snapshot_lights;
+	SkyMap sky;
+	mesh_snapshot(&map, block_maps);
+	mesh_snapshot_lights(&snapshot_lights, light_maps);
+	mesh_snapshot_sky(&sky, sky_maps);
+
+	double counts[SYNTHETIC_RUNS];
+	Timings count = {counts, 0, 0};
+	long faces = 0;
+	MeshAlgorithm algorithms[2] = {
+	    {"plain", compute_chunk, {(double*)malloc(sizeof(double) * SYNTHETIC_RUNS), 0, 0}, 0},
+	    {"greedy", compute_chunk_greedy, {(double*)malloc(sizeof(double) * SYNTHETIC_RUNS), 0, 0}, 0}
+	};
+	for(int run = 0; run < SYNTHETIC_RUNS; run++) {
+	    double start = now();
+	    faces = 0;
+	    for(int i = 0; i < CHUNK_SECTIONS && i * SECTION_HEIGHT < map.top; i++) {
+		faces += count_faces(ctx, &map, i * SECTION_HEIGHT, (i + 1) * SECTION_HEIGHT);
+	    }
+	    double elapsed = now() - start;
+	    count.times[count.count++] = elapsed;
+	    count.total += elapsed;
+	    mesh_with(algorithms + 0, ctx, &map, &snapshot_lights, &sky);
+	    mesh_with(algorithms + 1, ctx, &map, &snapshot_lights, &sky);
+	}
+	qsort(count.times, count.count, sizeof(double), double_cmp);
+	printf("%-8s count  %7ld faces            p50 %7.3f ms\n",
+	       synthetic_names[kind], faces, percentile(&count, 50));
+	for(int i = 0; i < 2; i++) {
+	    MeshAlgorithm *algorithm = algorithms + i;
+	    qsort(algorithm->timings.times, algorithm->timings.count, sizeof(double), double_cmp);
+	    printf("%-8s %-6s %7ld faces %8ld vertices p50 %7.3f ms\n",
+		   synthetic_names[kind], algorithm->name, algorithm->faces / SYNTHETIC_RUNS,
+		   algorithm->faces / SYNTHETIC_RUNS * 4, percentile(&algorithm->timings, 50));
+	    free(algorithm->timings.times);
+	}
+
+	chunk_map_free(&map);
+	map_free(&snapshot_lights);
+	sky_free(&sky);
+	for(int a = 0; a < 3; a++) {
+	    for(int b = 0; b < 3; b++) {
+		chunk_map_free(&maps[a][b]);
+		map_free(&lights[a][b]);
+		sky_free(&skies[a][b]);
+	    }
+	}
+    }
+}
+
+typedef int (*block_get)(void *store, int x, int y, int z);
+
+typedef struct {
+    const char *name;
+    block_get get;
+    void *stores;
+    size_t stride;
+} BlockStore;
+
+static int chunk_map_block(void *store, int x, int y, int z) {
+    return chunk_map_get((ChunkMap*)store, x, y, z);
+}
+
+static int map_block(void *store, int x, int y, int z) {
+    return map_get((Map*)store, x, y, z);
+}
+
+static unsigned int random_next(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// Reads of one access pattern over every chunk, returns the reads made
+// and sums the blocks read into sum so none of them can be skipped
+static long access_pattern(BlockStore *store, BenchChunk *chunks, int count, int pattern, long *sum) {
+    long reads = 0;
+    unsigned int state = 1;
+    for(int i = 0; i < count; i++) {
+	void *blocks = (char*)store->stores + store->stride * i;
+	int dx = chunks[i].p * CHUNK_SIZE;
+	int dz = chunks[i].q * CHUNK_SIZE;
+	int top = chunks[i].map.top;
+	if(pattern == 0) {
+	    // compute_chunk: every block of the chunk and its six neighbors
+	    for(int x = dx; x < dx + CHUNK_SIZE; x++) {
+		for(int z = dz; z < dz + CHUNK_SIZE; z++) {
+		    for(int y = 0; y < top; y++) {
+			*sum += store->get(blocks, x, y, z);
+			*sum += store->get(blocks, x - 1, y, z) + store->get(blocks, x + 1, y, z);
+			*sum += store->get(blocks, x, y - 1, z) + store->get(blocks, x, y + 1, z);
+			*sum += store->get(blocks, x, y, z - 1) + store->get(blocks, x, y, z + 1);
+			reads += 7;
+		    }
+		}
+	    }
+	}
+	else if(pattern == 1) {
+	    // collide: the six sides of a player two blocks high
+	    for(int j = 0; j < 4096; j++) {
+		int x = dx + random_next(&state) % CHUNK_SIZE;
+		int y = random_next(&state) % (top + 1);
+		int z = dz + random_next(&state) % CHUNK_SIZE;
+		for(int dy = 0; dy < 2; dy++) {
+		    *sum += store->get(blocks, x - 1, y - dy, z) + store->get(blocks, x + 1, y - dy, z);
+		    *sum += store->get(blocks, x, y - dy - 1, z) + store->get(blocks, x, y - dy + 1, z);
+		    *sum += store->get(blocks, x, y - dy, z - 1) + store->get(blocks, x, y - dy, z + 1);
+		    reads += 6;
+		}
+	    }
+	}
+	else {
+	    // _hit_test: rays of 8 blocks in 1/32 steps, a read per new block
+	    for(int j = 0; j < 1024; j++) {
+		float x = dx + random_next(&state) % CHUNK_SIZE;
+		float y = random_next(&state) % (top + 1);
+		float z = dz + random_next(&state) % CHUNK_SIZE;
+		float vx = (random_next(&state) % 2001) / 1000.0 - 1;
+		float vy = (random_next(&state) % 2001) / 1000.0 - 1;
+		float vz = (random_next(&state) % 2001) / 1000.0 - 1;
+		int px = 0, py = 0, pz = 0;
+		for(int k = 0; k < 8 * 32; k++) {
+		    int nx = roundf(x);
+		    int ny = roundf(y);
+		    int nz = roundf(z);
+		    if(nx != px || ny != py || nz != pz) {
+			int hw = store->get(blocks, nx, ny, nz);
+			reads++;
+			if(hw > 0) {
+			    *sum += hw;
+			    break;
+			}
+			px = nx; py = ny; pz = nz;
+		    }
+		    x += vx / 32; y += vy / 32; z += vz / 32;
+		}
+	    }
+	}
+    }
+    return reads;
+}
+
+static void bench_access(BenchChunk *chunks, int count) {
+    static const char *patterns[3] = {"compute_chunk", "collide", "_hit_test"};
+    Map *maps = (Map*)calloc(count, sizeof(Map));
+    long map_bytes = 0;
+    long chunk_bytes = 0;
+    for(int i = 0; i < count; i++) {
+	ChunkMap *chunk_map = &chunks[i].map;
+	Map *map = maps + i;
+	map_alloc(map, chunk_map->dx - 1, 0, chunk_map->dz - 1, 0x7fff);
+	CHUNK_MAP_FOR_EACH(chunk_map, ex, ey, ez, ew) {
+	    map_set(map, ex, ey, ez, ew);
+	} END_CHUNK_MAP_FOR_EACH;
+	map_bytes += sizeof(Map) + (map->mask + 1) * sizeof(MapEntry);
+	chunk_bytes += chunk_map_bytes(chunk_map);
+    }
+    BlockStore stores[2] = {
+	{"ChunkMap", chunk_map_block, &chunks[0].map, sizeof(BenchChunk)},
+	{"Map", map_block, maps, sizeof(Map)}
+    };
+    printf("blocks in ChunkMap %.1f MB, in Map %.1f MB\n", chunk_bytes / 1048576.0, map_bytes / 1048576.0);
+    for(int pattern = 0; pattern < 3; pattern++) {
+	for(int j = 0; j < 2; j++) {
+	    long sum = 0;
+	    double start = now();
+	    long reads = access_pattern(stores + j, chunks, count, pattern, &sum);
+	    double elapsed = now() - start;
+	    printf("%-13s %-8s %10ld reads %9.1f ms %7.2f ns/read  (sum %ld)\n",
+		   patterns[pattern], stores[j].name, reads, elapsed, elapsed * 1e6 / reads, sum);
+	}
+    }
+    for(int i = 0; i < count; i++) {
+	map_free(maps + i);
+    }
+    free(maps);
+}
+
+typedef struct {
+    int p;
+    int q;
+} IndexKey;
+
+static void* scan_keys(IndexKey *keys, int count, int p, int q) {
+    for(int i = 0; i < count; i++) {
+	if(keys[i].p == p && keys[i].q == q) {
+	    return keys + i;
+	}
+    }
+    return 0;
+}
+
+// Lookups of every chunk around the center out to one past the radius,
+// so a few of them miss, the mix find_chunk sees from force_chunks
+static void bench_index_radius(int radius, int shifts) {
+    int size = 2 * radius + 1;
+    int count = size * size;
+    IndexKey *keys = (IndexKey*)malloc(sizeof(IndexKey) * count);
+    ChunkIndex index;
+    chunk_index_alloc(&index, 0xfff);
+    // Walk the window along p first so the index holds tombstones like
+    // it does after the player moved for a while
+    for(int shift = 0; shift <= shifts; shift++) {
+	for(int a = -radius; a <= radius; a++) {
+	    for(int b = -radius; b <= radius; b++) {
+		if(shift && a != radius) {
+		    continue;
+		}
+		chunk_index_set(&index, shift + a, b, keys);
+	    }
+	}
+	if(shift) {
+	    for(int b = -radius; b <= radius; b++) {
+		chunk_index_remove(&index, shift - radius - 1, b);
+	    }
+	}
+    }
+    for(int i = 0; i < count; i++) {
+	keys[i].p = shifts + i / size - radius;
+	keys[i].q = i % size - radius;
+    }
+    long lookups = 0;
+    long found = 0;
+    double start = now();
+    while(lookups < 20000000) {
+	for(int a = -radius - 1; a <= radius + 1; a++) {
+	    for(int b = -radius - 1; b <= radius + 1; b++) {
+		found += chunk_index_get(&index, shifts + a, b) != 0;
+		lookups++;
+	    }
+	}
+    }
+    double indexed = now() - start;
+    long scans = 0;
+    start = now();
+    while(scans < 20000000 / count + 1000) {
+	for(int a = -radius - 1; a <= radius + 1; a++) {
+	    for(int b = -radius - 1; b <= radius + 1; b++) {
+		found += scan_keys(keys, count, shifts + a, b) != 0;
+		scans++;
+	    }
+	}
+    }
+    double scanned = now() - start;
+    printf("radius %2d  %5d chunks  mask %#6x  used %5u  index %6.2f ns/lookup  scan %9.2f ns/lookup  (found %ld)\n",
+	   radius, count, index.mask, index.used, indexed * 1e6 / lookups, scanned * 1e6 / scans, found);
+    chunk_index_free(&index);
+    free(keys);
+}
+
+static void bench_index() {
+    bench_index_radius(3, 0);
+    bench_index_radius(3, 256);
+    bench_index_radius(30, 0);
+    bench_index_radius(30, 256);
+}
+
+int main(int argc, char **argv) {
+    int radius = 8;
+    const char *trace = 0;
+    int access = 0;
+    int index = 0;
+    int greedy = 0;
+    int synthetic = 0;
+    for(int i = 1; i < argc; i++) {
+	if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+	    radius = atoi(argv[++i]);
+	}
+	else if(!strcmp(argv[i], "-s") && i + 1 < argc) {
+	    seed(atoi(argv[++i]));
+	}
+	else if(!strcmp(argv[i], "-p") && i + 1 < argc) {
+	    trace = argv[++i];
+	}
+	else if(!strcmp(argv[i], "-a")) {
+	    access = 1;
+	}
+	else if(!strcmp(argv[i], "-i")) {
+	    index = 1;
+	}
+	else if(!strcmp(argv[i], "-g")) {
+	    greedy = 1;
+	}
+	else if(!strcmp(argv[i], "-x")) {
+	    synthetic = 1;
+	}
+	else {
+	    fprintf(stderr, "usage: %s [-r radius] [-s seed] [-p trace.json] [-a] [-i] [-g] [-x]\n", argv[0]);
+	    return 1;
+	}
+    }
+    int size = 2 * radius + 1;
+    int count = size * size;
+    BenchChunk *chunks = (BenchChunk*)calloc(count, sizeof(BenchChunk));
+    Timings gen = {(double*)malloc(sizeof(double) * count), 0, 0};
+    Timings mesh = {(double*)malloc(sizeof(double) * count), 0, 0};
+    MeshAlgorithm algorithms[2] = {
+	{"plain", compute_chunk, {(double*)malloc(sizeof(double) * count), 0, 0}, 0},
+	{"greedy", compute_chunk_greedy, {(double*)malloc(sizeof(double) * count), 0, 0}, 0}
+    };
+    profile_init();
+    // Zones only cost a test unless a trace was asked for
+    profile_record(trace != 0);
+    region_init();
+    mesh_thread_init();
+    MeshContext *ctx = mesh_context();
+
+    for(int i = 0; i < count; i++) {
+	BenchChunk *chunk = chunks + i;
+	chunk->p = i / size - radius;
+	chunk->q = i % size - radius;
+	double start = now();
+	generate(chunk);
+	double elapsed = now() - start;
+	gen.times[gen.count++] = elapsed;
+	gen.total += elapsed;
+    }
+
+    // Chunks on the border mesh against the edges of missing neighbors
+    long faces = 0;
+    long cloud_faces = 0;
+    for(int i = 0; i < count; i++) {
+	BenchChunk *chunk = chunks + i;
+	ChunkMap *block_maps[3][3];
+	Map *light_maps[3][3];
+	SkyMap *sky_maps[3][3];
+	for(int dp = -1; dp <= 1; dp++) {
+	    for(int dq = -1; dq <= 1; dq++) {
+		int a = i / size + dp;
+		int b = i % size + dq;
+		BenchChunk *other = 0;
+		if(a >= 0 && a < size && b >= 0 && b < size) {
+		    other = chunks + a * size + b;
+		}
+		block_maps[dp + 1][dq + 1] = other ? &other->map : 0;
+		light_maps[dp + 1][dq + 1] = other ? &other->lights : 0;
+		sky_maps[dp + 1][dq + 1] = other ? &other->sky : 0;
+	    }
+	}
+	double start = now();
+	ChunkMap map;
+	Map lights;
+	SkyMap sky;
+	Mesh meshes[CHUNK_SECTIONS];
+	memset(meshes, 0, sizeof(meshes));
+	mesh_snapshot(&map, block_maps);
+	mesh_snapshot_lights(&lights, light_maps);
+	mesh_snapshot_sky(&sky, sky_maps);
+	mesh_chunk(ctx, meshes, ALL_SECTIONS, &map, &lights, &sky);
+	double elapsed = now() - start;
+	mesh.times[mesh.count++] = elapsed;
+	mesh.total += elapsed;
+	for(int j = 0; j < CHUNK_SECTIONS; j++) {
+	    faces += meshes[j].faces;
+	    mesh_free(meshes + j);
+	}
+	cloud_faces += chunk->clouds.faces;
+	if(greedy) {
+	    mesh_with(algorithms + 0, ctx, &map, &lights, &sky);
+	    mesh_with(algorithms + 1, ctx, &map, &lights, &sky);
+	}
+	chunk_map_free(&map);
+	map_free(&lights);
+	sky_free(&sky);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("radius %d, %d chunks\n", radius, count);
+    report("gen", &gen);
+    report("mesh", &mesh);
+    printf("faces %ld (%.1f per chunk, %.0f faces/s meshing), cloud faces %ld\n",
+	   faces, (double)faces / count, faces * 1e3 / mesh.total, cloud_faces);
+    printf("peak memory %.1f MB\n", usage.ru_maxrss / 1024.0);
+    for(int i = 0; greedy && i < 2; i++) {
+	MeshAlgorithm *algorithm = algorithms + i;
+	report(algorithm->name, &algorithm->timings);
+	printf("%-6s faces %ld, vertices %ld, %.1f faces per chunk\n", algorithm->name,
+	       algorithm->faces, algorithm->faces * 4, (double)algorithm->faces / count);
+    }
+    if(access) {
+	bench_access(chunks, count);
+    }
+    if(index) {
+	bench_index();
+    }
+    if(synthetic) {
+	bench_synthetic(ctx);
+    }
+    if(trace && !profile_dump(trace)) {
+	fprintf(stderr, "could not write %s\n", trace);
+    }
+
+    for(int i = 0; i < count; i++) {
+	chunk_map_free(&chunks[i].map);
+	map_free(&chunks[i].lights);
+	sky_free(&chunks[i].sky);
+	mesh_free(&chunks[i].clouds);
+    }
+    free(chunks);
+    free(gen.times);
+    free(mesh.times);
+    free(algorithms[0].timings.times);
+    free(algorithms[1].timings.times);
+    region_free();
+    profile_free();
+    return 0;
+}
@@ -1,6 +1,7 @@
 #version 330 core
 
 in vec2  frag_uv;
+flat in vec2 frag_tile;
 in float frag_ao;
 in float frag_light;
 in float diffuse;
@@ -19,14 +20,17 @@ const float pi = 3.14159265;
 
 void main()
 {
-    vec3 color = texture(sampler, frag_uv).rgb;
-    if(color == vec3(1.0, 0.0, 1.0)) {
-	discard;
-    }
+    // Repeat the tile across merged quads, inset to stay off its neighbors
+    vec2 uv = clamp(fract(frag_uv), 1.0 / 128.0, 127.0 / 128.0);
+    vec3 color = texture(sampler, (frag_tile + uv) * 0.0625).rgb;
     bool cloud = color == vec3(1.0);
-    if(cloud && ortho) {
+#ifndef OPAQUE
+    // Only the cut-out pass may discard, it would turn off early depth
+    // testing for the opaque one
+    if(color == vec3(1.0, 0.0, 1.0) || (cloud && ortho)) {
 	discard;
     }
+#endif
     float df = cloud ? 1.0 - diffuse * 0.2 : diffuse;
     float ao = cloud ? 1.0 - (1.0 - frag_ao) * 0.2 : frag_ao;
     df = min(1.0, df + frag_light);	    
@@ -1,15 +1,17 @@
 #version 330 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec4 uv;
+// Packed vertex, see cube.h for the layout
+layout(location = 0) in uvec2 vertex;
 
 uniform mat4 matrix;
-uniform vec3 camera;
+uniform ivec3 camera_block;
+uniform vec3 camera_offset;
+uniform isamplerBuffer pages;
 uniform bool ortho;
 uniform float fog_distance;
 
 out vec2  frag_uv;
+flat out vec2 frag_tile;
 out float frag_ao;
 out float frag_light;
 out float diffuse;
@@ -18,23 +20,72 @@ out float fog_factor;
 
 const float pi = 3.14159265;
 const vec3 light_dir = normalize(vec3(-1.0, 1.0, -1.0));
+const vec3 normals[6] = vec3[6](
+    vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0), vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0)
+);
+const vec3 plant_normals[4] = vec3[4](
+    vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0)
+);
+
+// Vertices of one page of the mesh arena, see ARENA_PAGE in main.c
+const int page_vertices = 64 * 4;
 
 void main()
 {
+    // Mesh positions are block corners relative to the chunk of the page.
+    // Positions are taken relative to the camera in integers first, so
+    // their precision only depends on the distance from the camera.
+    ivec2 chunk = texelFetch(pages, gl_VertexID / page_vertices).xy;
+    ivec3 origin = ivec3(chunk.x * 32, 0, chunk.y * 32) - camera_block;
+    vec3 position = vec3(origin) - 0.5 - camera_offset + vec3(
+	float(vertex.x & 63u),
+	float((vertex.x >> 6u) & 511u),
+	float((vertex.x >> 15u) & 63u));
+    uint face = (vertex.x >> 21u) & 7u;
+    uint tile = vertex.y & 255u;
+    uint u = (vertex.y >> 8u) & 511u;
+    uint v = (vertex.y >> 17u) & 511u;
+    vec3 normal;
+    if(face == 6u) {
+	// Plant quads cross at the block center, u holds the quad index
+	uint quad = u >> 1u;
+	u &= 1u;
+	vec2 corner = vec2(float(u), float(v)) - 0.5;
+	vec3 offset;
+	if(quad < 2u) {
+	    offset = vec3(0.0, corner.y, quad == 0u ? corner.x : -corner.x);
+	}
+	else {
+	    offset = vec3(quad == 2u ? corner.x : -corner.x, corner.y, 0.0);
+	}
+	float angle = float(vertex.y >> 26u) * pi / 32.0;
+	float s = sin(angle);
+	float c = cos(angle);
+	mat3 rotation = mat3(c, 0.0, s, 0.0, 1.0, 0.0, -s, 0.0, c);
+	position += 0.5 + rotation * offset;
+	normal = rotation * plant_normals[quad];
+    }
+    else {
+	normal = normals[face];
+    }
     gl_Position = matrix * vec4(position, 1.0);
-    frag_uv = uv.xy;
-    frag_ao = 0.3 + (1.0 - uv.z) * 0.7;
-    frag_light = uv.w;
+    frag_tile = vec2(float(tile & 15u), float(tile >> 4u));
+    frag_uv = vec2(float(u), float(v));
+    frag_ao = 0.3 + (1.0 - float((vertex.x >> 24u) & 15u) / 15.0) * 0.7;
+    frag_light = float(vertex.x >> 28u) / 15.0;
     diffuse = max(0.0, dot(normal, light_dir));
     if(ortho) {
 	fog_factor = 0.0;
 	fog_height = 0.0;
     }
     else {
-	// float camera_distance = distance(camera, position);
+	// float camera_distance = length(position);
 	// fog_factor = pow(clamp(camera_distance / fog_distance, 0.0, 1.0), 4.0);
-	// float dy = position.y - camera.y;
-	// float dx = distance(position.xz, camera.xz);
+	// float dy = position.y;
+	// float dx = length(position.xz);
 	// fog_height = (atan(dy, dx) + pi / 2) / pi;
     }
 }
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+
+void arena_init(Arena *arena, int capacity) {
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->count = 1;
+    arena->size = 64;
+    arena->blocks = (ArenaBlock*)malloc(sizeof(ArenaBlock) * arena->size);
+    arena->blocks[0].offset = 0;
+    arena->blocks[0].size = capacity;
+    arena->blocks[0].owner = 0;
+}
+
+void arena_free(Arena *arena) {
+    free(arena->blocks);
+    arena->blocks = 0;
+    arena->count = 0;
+}
+
+static void arena_insert(Arena *arena, int index, ArenaBlock *block) {
+    if(arena->count == arena->size) {
+	arena->size *= 2;
+	arena->blocks = (ArenaBlock*)realloc(arena->blocks, sizeof(ArenaBlock) * arena->size);
+    }
+    memmove(arena->blocks + index + 1, arena->blocks + index,
+	    sizeof(ArenaBlock) * (arena->count - index));
+    arena->blocks[index] = *block;
+    arena->count++;
+}
+
+static void arena_remove(Arena *arena, int index) {
+    arena->count--;
+    memmove(arena->blocks + index, arena->blocks + index + 1,
+	    sizeof(ArenaBlock) * (arena->count - index));
+}
+
+// Claims size pages from the smallest free block that fits them. Returns
+// the first page, or -1 when no free block is large enough, compacting
+// first may make room.
+int arena_claim(Arena *arena, int size, void *owner) {
+    int best = -1;
+    for(int i = 0; i < arena->count; i++) {
+	ArenaBlock *block = arena->blocks + i;
+	if(!block->owner && block->size >= size &&
+	   (best < 0 || block->size < arena->blocks[best].size)) {
+	    best = i;
+	}
+    }
+    if(best < 0) {
+	return -1;
+    }
+    ArenaBlock *block = arena->blocks + best;
+    int offset = block->offset;
+    if(block->size > size) {
+	ArenaBlock rest = {offset + size, block->size - size, 0};
+	block->size = size;
+	arena_insert(arena, best + 1, &rest);
+	block = arena->blocks + best;
+    }
+    block->owner = owner;
+    arena->used += size;
+    return offset;
+}
+
+// Frees the block claimed at offset and merges it with free neighbors
+void arena_release(Arena *arena, int offset) {
+    int lo = 0;
+    int hi = arena->count - 1;
+    while(lo < hi) {
+	int mid = (lo + hi) / 2;
+	if(arena->blocks[mid].offset < offset) {
+	    lo = mid + 1;
+	}
+	else {
+	    hi = mid;
+	}
+    }
+    ArenaBlock *block = arena->blocks + lo;
+    if(block->offset != offset || !block->owner) {
+	return;
+    }
+    block->owner = 0;
+    arena->used -= block->size;
+    if(lo + 1 < arena->count && !arena->blocks[lo + 1].owner) {
+	block->size += arena->blocks[lo + 1].size;
+	arena_remove(arena, lo + 1);
+    }
+    if(lo > 0 && !arena->blocks[lo - 1].owner) {
+	arena->blocks[lo - 1].size += block->size;
+	arena_remove(arena, lo);
+    }
+}
+
+// Packs the claimed blocks in order from page 0 of a buffer of capacity
+// pages, capacity must hold all of them. move is called for every block,
+// from the old offset in the old buffer to the new one in the new buffer.
+void arena_compact(Arena *arena, int capacity, arena_move_func move, void *arg) {
+    int count = 0;
+    int offset = 0;
+    for(int i = 0; i < arena->count; i++) {
+	ArenaBlock *block = arena->blocks + i;
+	if(!block->owner) {
+	    continue;
+	}
+	move(block->owner, block->offset, offset, block->size, arg);
+	block->offset = offset;
+	offset += block->size;
+	arena->blocks[count++] = *block;
+    }
+    arena->count = count;
+    arena->capacity = capacity;
+    if(offset < capacity) {
+	ArenaBlock rest = {offset, capacity - offset, 0};
+	arena_insert(arena, count, &rest);
+    }
+}
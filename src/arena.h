@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+
+// Run of pages, owned by the caller that claimed it or free when owner is 0
+typedef struct {
+    int offset;
+    int size;
+    void *owner;
+} ArenaBlock;
+
+// Hands out runs of pages from a buffer of capacity pages. Blocks are
+// sorted by offset and cover the whole buffer, neighboring free blocks
+// are merged as soon as they appear. Nothing here touches the buffer
+// itself, compacting reports the moves for the caller to carry out.
+typedef struct {
+    int capacity;
+    int used;
+    int count;
+    int size;
+    ArenaBlock *blocks;
+} Arena;
+
+typedef void (*arena_move_func)(void *owner, int from, int to, int size, void *arg);
+
+
+void arena_init(Arena *arena, int capacity);
+
+void arena_free(Arena *arena);
+
+int arena_claim(Arena *arena, int size, void *owner);
+
+void arena_release(Arena *arena, int offset);
+
+void arena_compact(Arena *arena, int capacity, arena_move_func move, void *arg);
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+
+#include "chunk_index.h"
+
+static char tombstone;
+
+#define TOMBSTONE ((void*)&tombstone)
+
+
+static unsigned int chunk_hash(int p, int q) {
+    unsigned int h = (unsigned int)p * 73856093u ^ (unsigned int)q * 19349663u;
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    h ^= h >> 16;
+    return h;
+}
+
+static ChunkIndexEntry* chunk_index_find(ChunkIndex *index, int p, int q) {
+    unsigned int i = chunk_hash(p, q) & index->mask;
+    ChunkIndexEntry *entry = index->data + i;
+    while(entry->value) {
+	if(entry->value != TOMBSTONE && entry->p == p && entry->q == q) {
+	    return entry;
+	}
+	i = (i + 1) & index->mask;
+	entry = index->data + i;
+    }
+    return 0;
+}
+
+static void chunk_index_grow(ChunkIndex *index) {
+    ChunkIndex new_index;
+    unsigned int mask = index->mask;
+    if(index->size * 4 > index->mask) {
+	mask = (mask << 1) | 1;
+    }
+    chunk_index_alloc(&new_index, mask);
+    for(unsigned int i = 0; i <= index->mask; i++) {
+	ChunkIndexEntry *entry = index->data + i;
+	if(entry->value && entry->value != TOMBSTONE) {
+	    chunk_index_set(&new_index, entry->p, entry->q, entry->value);
+	}
+    }
+    free(index->data);
+    *index = new_index;
+}
+
+void chunk_index_alloc(ChunkIndex *index, int mask) {
+    index->mask = mask;
+    index->size = 0;
+    index->used = 0;
+    index->data = (ChunkIndexEntry*)calloc(index->mask + 1, sizeof(ChunkIndexEntry));
+}
+
+void chunk_index_free(ChunkIndex *index) {
+    free(index->data);
+    index->data = 0;
+    index->size = 0;
+    index->used = 0;
+}
+
+void* chunk_index_get(ChunkIndex *index, int p, int q) {
+    ChunkIndexEntry *entry = chunk_index_find(index, p, q);
+    return entry ? entry->value : 0;
+}
+
+void chunk_index_set(ChunkIndex *index, int p, int q, void *value) {
+    if(!value) {
+	chunk_index_remove(index, p, q);
+	return;
+    }
+    ChunkIndexEntry *entry = chunk_index_find(index, p, q);
+    if(entry) {
+	entry->value = value;
+	return;
+    }
+    unsigned int i = chunk_hash(p, q) & index->mask;
+    entry = index->data + i;
+    while(entry->value && entry->value != TOMBSTONE) {
+	i = (i + 1) & index->mask;
+	entry = index->data + i;
+    }
+    if(!entry->value) {
+	index->used++;
+    }
+    entry->p = p;
+    entry->q = q;
+    entry->value = value;
+    index->size++;
+    if(index->used * 2 > index->mask) {
+	chunk_index_grow(index);
+    }
+}
+
+void chunk_index_remove(ChunkIndex *index, int p, int q) {
+    ChunkIndexEntry *entry = chunk_index_find(index, p, q);
+    if(entry) {
+	entry->value = TOMBSTONE;
+	index->size--;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef CHUNK_INDEX_H
+#define CHUNK_INDEX_H
+
+
+// Open-addressing table from chunk coordinates (p, q) to a chunk pointer
+typedef struct {
+    int p;
+    int q;
+    void *value;
+} ChunkIndexEntry;
+
+typedef struct {
+    unsigned int mask;
+    unsigned int size;
+    unsigned int used;
+    ChunkIndexEntry *data;
+} ChunkIndex;
+
+
+void chunk_index_alloc(ChunkIndex *index, int mask);
+
+void chunk_index_free(ChunkIndex *index);
+
+void* chunk_index_get(ChunkIndex *index, int p, int q);
+
+void chunk_index_set(ChunkIndex *index, int p, int q, void *value);
+
+void chunk_index_remove(ChunkIndex *index, int p, int q);
+
+
+#endif
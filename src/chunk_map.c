@@ -0,0 +1,250 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_map.h"
+
+
+static unsigned int packed_words(int bits) {
+    return (unsigned int)((uint64_t)CHUNK_VOLUME * bits / 64);
+}
+
+static void packed_put(uint64_t *data, int bits, unsigned int index, unsigned int value) {
+    unsigned int shift = (index * bits) & 63;
+    uint64_t mask = (((uint64_t)1 << bits) - 1) << shift;
+    uint64_t *word = data + ((index * bits) >> 6);
+    *word = (*word & ~mask) | ((uint64_t)value << shift);
+}
+
+static unsigned int packed_take(const uint64_t *data, int bits, unsigned int index) {
+    unsigned int shift = (index * bits) & 63;
+    return (data[(index * bits) >> 6] >> shift) & ((1u << bits) - 1);
+}
+
+static void chunk_map_repack(ChunkMap *map, int bits) {
+    uint64_t *data = (uint64_t*)calloc(packed_words(bits), sizeof(uint64_t));
+    if(map->bits) {
+	for(int lx = 0; lx < CHUNK_SIZE; lx++) {
+	    for(int lz = 0; lz < CHUNK_SIZE; lz++) {
+		for(int y = 0; y < map->top; y++) {
+		    unsigned int index = CHUNK_INDEX(lx, y, lz);
+		    unsigned int value = packed_take(map->data, map->bits, index);
+		    if(value) {
+			packed_put(data, bits, index, value);
+		    }
+		}
+	    }
+	}
+    }
+    free(map->data);
+    map->data = data;
+    map->bits = bits;
+}
+
+static int chunk_map_palette_index(ChunkMap *map, int w) {
+    for(int i = 0; i < map->palette_size; i++) {
+	if(map->palette[i] == w) {
+	    return i;
+	}
+    }
+    if(map->palette_size == 256) {
+	return -1;
+    }
+    if(map->palette_size >= (1 << map->bits)) {
+	chunk_map_repack(map, map->bits ? map->bits * 2 : 1);
+    }
+    map->palette[map->palette_size] = w;
+    return map->palette_size++;
+}
+
+void chunk_map_alloc(ChunkMap *map, int dx, int dz) {
+    map->dx = dx;
+    map->dz = dz;
+    map->bits = 0;
+    map->palette_size = 1;
+    memset(map->palette, 0, sizeof(map->palette));
+    map->data = 0;
+    map->size = 0;
+    map->top = 0;
+    map->ring = 0;
+    memset(map->edge_height, 0, sizeof(map->edge_height));
+    memset(map->edge_block, 0, sizeof(map->edge_block));
+}
+
+void chunk_map_free(ChunkMap *map) {
+    free(map->data);
+    free(map->ring);
+    map->data = 0;
+    map->ring = 0;
+    map->bits = 0;
+    map->palette_size = 1;
+    map->size = 0;
+    map->top = 0;
+}
+
+void chunk_map_copy(ChunkMap *dst, const ChunkMap *src) {
+    *dst = *src;
+    dst->data = 0;
+    dst->ring = 0;
+    if(src->bits) {
+	size_t size = packed_words(src->bits) * sizeof(uint64_t);
+	dst->data = (uint64_t*)malloc(size);
+	memcpy(dst->data, src->data, size);
+    }
+    if(src->ring) {
+	size_t size = CHUNK_RING_COLUMNS * CHUNK_HEIGHT;
+	dst->ring = (signed char*)malloc(size);
+	memcpy(dst->ring, src->ring, size);
+    }
+}
+
+int chunk_map_ring_index(int lx, int lz) {
+    if(lx < -1 || lx > CHUNK_SIZE || lz < -1 || lz > CHUNK_SIZE) {
+	return -1;
+    }
+    if(lz == -1) {
+	return lx + 1;
+    }
+    if(lz == CHUNK_SIZE) {
+	return (CHUNK_SIZE + 2) + lx + 1;
+    }
+    if(lx == -1) {
+	return (CHUNK_SIZE + 2) * 2 + lz;
+    }
+    if(lx == CHUNK_SIZE) {
+	return (CHUNK_SIZE + 2) * 2 + CHUNK_SIZE + lz;
+    }
+    return -1;
+}
+
+int chunk_map_ring_get(const ChunkMap *map, int lx, int y, int lz) {
+    int index = chunk_map_ring_index(lx, lz);
+    if(index < 0 || !map->ring) {
+	return 0;
+    }
+    return map->ring[index * CHUNK_HEIGHT + y];
+}
+
+signed char* chunk_map_ring_column(ChunkMap *map, int lx, int lz) {
+    int index = chunk_map_ring_index(lx, lz);
+    if(index < 0) {
+	return 0;
+    }
+    if(!map->ring) {
+	map->ring = (signed char*)calloc(CHUNK_RING_COLUMNS * CHUNK_HEIGHT, sizeof(signed char));
+    }
+    return map->ring + index * CHUNK_HEIGHT;
+}
+
+static int chunk_map_ring_set(ChunkMap *map, int lx, int y, int lz, int w) {
+    int index = chunk_map_ring_index(lx, lz);
+    if(index < 0) {
+	return 0;
+    }
+    if(!map->ring) {
+	if(!w) {
+	    return 0;
+	}
+	map->ring = (signed char*)calloc(CHUNK_RING_COLUMNS * CHUNK_HEIGHT, sizeof(signed char));
+    }
+    signed char *entry = map->ring + index * CHUNK_HEIGHT + y;
+    if(*entry == w) {
+	return 0;
+    }
+    *entry = w;
+    return 1;
+}
+
+int chunk_map_set(ChunkMap *map, int x, int y, int z, int w) {
+    int lx = x - map->dx;
+    int lz = z - map->dz;
+    if(y < 0 || y >= CHUNK_HEIGHT) {
+	return 0;
+    }
+    if(lx < 0 || lx >= CHUNK_SIZE || lz < 0 || lz >= CHUNK_SIZE) {
+	return chunk_map_ring_set(map, lx, y, lz, w);
+    }
+    int previous = chunk_map_local_get(map, lx, y, lz);
+    if(previous == w) {
+	return 0;
+    }
+    // Item ids fit in far fewer than 256 palette entries
+    int value = chunk_map_palette_index(map, w);
+    assert(value >= 0);
+    packed_put(map->data, map->bits, CHUNK_INDEX(lx, y, lz), value);
+    if(!previous) {
+	map->size++;
+    }
+    else if(!w) {
+	map->size--;
+    }
+    if(w && y >= map->top) {
+	map->top = y + 1;
+    }
+    return 1;
+}
+
+int chunk_map_get(ChunkMap *map, int x, int y, int z) {
+    int lx = x - map->dx;
+    int lz = z - map->dz;
+    if(y < 0 || y >= CHUNK_HEIGHT) {
+	return 0;
+    }
+    if(lx < 0 || lx >= CHUNK_SIZE || lz < 0 || lz >= CHUNK_SIZE) {
+	return chunk_map_ring_get(map, lx, y, lz);
+    }
+    return chunk_map_local_get(map, lx, y, lz);
+}
+
+// Sets the run y0 <= y < y1 of a column of the chunk to w, the palette is
+// looked up once for the whole run
+void chunk_map_fill(ChunkMap *map, int x, int y0, int y1, int z, int w) {
+    int lx = x - map->dx;
+    int lz = z - map->dz;
+    if(lx < 0 || lx >= CHUNK_SIZE || lz < 0 || lz >= CHUNK_SIZE) {
+	return;
+    }
+    y0 = y0 < 0 ? 0 : y0;
+    y1 = y1 > CHUNK_HEIGHT ? CHUNK_HEIGHT : y1;
+    if(y0 >= y1) {
+	return;
+    }
+    int value = chunk_map_palette_index(map, w);
+    assert(value >= 0);
+    unsigned int index = CHUNK_INDEX(lx, y0, lz);
+    for(int y = y0; y < y1; y++, index++) {
+	if(map->bits) {
+	    if(packed_take(map->data, map->bits, index)) {
+		map->size--;
+	    }
+	    packed_put(map->data, map->bits, index, value);
+	}
+	if(w) {
+	    map->size++;
+	}
+    }
+    if(w && y1 > map->top) {
+	map->top = y1;
+    }
+}
+
+// Records the generated ground of a ring column, blocks y < height are w
+void chunk_map_set_edge(ChunkMap *map, int x, int z, int height, int w) {
+    int index = chunk_map_ring_index(x - map->dx, z - map->dz);
+    if(index < 0) {
+	return;
+    }
+    map->edge_height[index] = height < 0 ? 0 : (height > 255 ? 255 : height);
+    map->edge_block[index] = w;
+}
+
+unsigned int chunk_map_bytes(const ChunkMap *map) {
+    unsigned int result = sizeof(ChunkMap);
+    if(map->bits) {
+	result += packed_words(map->bits) * sizeof(uint64_t);
+    }
+    if(map->ring) {
+	result += CHUNK_RING_COLUMNS * CHUNK_HEIGHT;
+    }
+    return result;
+}
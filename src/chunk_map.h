@@ -0,0 +1,84 @@
+#ifndef CHUNK_MAP_H
+#define CHUNK_MAP_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#define CHUNK_HEIGHT 256
+#define CHUNK_VOLUME (CHUNK_SIZE * CHUNK_SIZE * CHUNK_HEIGHT)
+#define CHUNK_RING_COLUMNS (CHUNK_SIZE * 4 + 4)
+#define SECTION_HEIGHT 16
+#define CHUNK_SECTIONS (CHUNK_HEIGHT / SECTION_HEIGHT)
+#define ALL_SECTIONS ((1u << CHUNK_SECTIONS) - 1)
+
+// Column-major: y is contiguous inside each (x, z) column
+#define CHUNK_INDEX(lx, y, lz) (((lx) * CHUNK_SIZE + (lz)) * CHUNK_HEIGHT + (y))
+
+#define CHUNK_MAP_FOR_EACH(map, ex, ey, ez, ew) \
+    for(int lx = 0; lx < CHUNK_SIZE; lx++) \
+    for(int lz = 0; lz < CHUNK_SIZE; lz++) \
+    for(int ey = 0; ey < (map)->top; ey++) { \
+	int ew = chunk_map_local_get(map, lx, ey, lz); \
+	if(!ew) { \
+	    continue; \
+	} \
+	int ex = (map)->dx + lx; \
+	int ez = (map)->dz + lz;
+
+#define END_CHUNK_MAP_FOR_EACH }
+
+
+// Dense block store of one chunk. Blocks are kept as bit-packed indices
+// into a small palette. Mesh snapshots fill the ring around the chunk
+// with the negated blocks of the neighbors, edge keeps the generated
+// ground of the ring columns to stand in for neighbors not loaded yet.
+typedef struct {
+    int dx;
+    int dz;
+    int bits;
+    int palette_size;
+    signed char palette[256];
+    uint64_t *data;
+    unsigned int size;
+    int top;
+    signed char *ring;
+    unsigned char edge_height[CHUNK_RING_COLUMNS];
+    signed char edge_block[CHUNK_RING_COLUMNS];
+} ChunkMap;
+
+
+void chunk_map_alloc(ChunkMap *map, int dx, int dz);
+
+void chunk_map_free(ChunkMap *map);
+
+void chunk_map_copy(ChunkMap *dst, const ChunkMap *src);
+
+int chunk_map_set(ChunkMap *map, int x, int y, int z, int w);
+
+int chunk_map_get(ChunkMap *map, int x, int y, int z);
+
+void chunk_map_fill(ChunkMap *map, int x, int y0, int y1, int z, int w);
+
+void chunk_map_set_edge(ChunkMap *map, int x, int z, int height, int w);
+
+static inline int chunk_map_local_get(const ChunkMap *map, int lx, int y, int lz) {
+    if(!map->bits) {
+	return 0;
+    }
+    unsigned int index = CHUNK_INDEX(lx, y, lz);
+    unsigned int shift = (index * map->bits) & 63;
+    uint64_t word = map->data[(index * map->bits) >> 6];
+    return map->palette[(word >> shift) & ((1u << map->bits) - 1)];
+}
+
+int chunk_map_ring_get(const ChunkMap *map, int lx, int y, int lz);
+
+int chunk_map_ring_index(int lx, int lz);
+
+signed char* chunk_map_ring_column(ChunkMap *map, int lx, int lz);
+
+unsigned int chunk_map_bytes(const ChunkMap *map);
+
+
+#endif
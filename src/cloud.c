@@ -0,0 +1,173 @@
+#include <stdlib.h>
+
+#include "cloud.h"
+#include "item.h"
+#include "util.h"
+#include "./third_party/noise.h"
+
+#define CLOUD_COVER 0.62
+#define CLOUD_COLUMN(lx, lz) (((lx) + 1) * CLOUD_SIZE + (lz) + 1)
+
+
+// Fills in the cloud thickness of every column of region
+void cloud_region(Region *region) {
+    float xs[REGION_SPAN];
+    float zs[REGION_SPAN];
+    float *cover = (float*)malloc(sizeof(float) * REGION_SPAN * REGION_SPAN);
+    for(int i = 0; i < REGION_SPAN; i++) {
+	xs[i] = (region->rp * REGION_SIZE - 1 + i) * -0.015;
+	zs[i] = (region->rq * REGION_SIZE - 1 + i) * 0.015;
+    }
+    simplex2_grid(cover, xs, REGION_SPAN, zs, REGION_SPAN, 6, 0.5, 2);
+    for(int i = 0; i < REGION_SPAN * REGION_SPAN; i++) {
+	float c = cover[i] - CLOUD_COVER;
+	region->columns[i].cloud = c < 0 ? 0 : MIN(CLOUD_THICKNESS, 1 + (int)(c * 30));
+    }
+    free(cover);
+}
+
+void cloud_field(unsigned char *depth, int p, int q) {
+    int x0 = p * CHUNK_SIZE - 1;
+    int z0 = q * CHUNK_SIZE - 1;
+    Region *region = region_acquire_chunk(p, q);
+    for(int i = 0; i < CLOUD_SIZE; i++) {
+	for(int j = 0; j < CLOUD_SIZE; j++) {
+	    depth[i * CLOUD_SIZE + j] = region_column(region, x0 + i, z0 + j)->cloud;
+	}
+    }
+    region_release(region);
+}
+
+static void cloud_span(const unsigned char *depth, int lx, int lz, int *y0, int *y1) {
+    int d = depth[CLOUD_COLUMN(lx, lz)];
+    *y0 = CLOUD_MIDDLE - d / 2;
+    *y1 = *y0 + d;
+}
+
+// Part k of the side of column (lx, lz) that the column next to it in
+// direction (dx, dz) leaves exposed, empty when y0 >= y1
+static void cloud_side(const unsigned char *depth, int lx, int lz, int dx, int dz, int k, int *y0, int *y1) {
+    int a0, a1, b0, b1;
+    cloud_span(depth, lx, lz, &a0, &a1);
+    cloud_span(depth, lx + dx, lz + dz, &b0, &b1);
+    if(a0 == a1 || b0 == b1) {
+	*y0 = k ? a1 : a0;
+	*y1 = a1;
+    }
+    else if(k) {
+	*y0 = MAX(a0, b1);
+	*y1 = a1;
+    }
+    else {
+	*y0 = a0;
+	*y1 = MIN(a1, b0);
+    }
+}
+
+// Tops and bottoms, rectangles of columns whose faces sit at the same y
+// are merged into one quad
+static int cloud_caps(uint32_t *data, const unsigned char *depth, int face, int tile) {
+    short level[CHUNK_SIZE * CHUNK_SIZE];
+    int faces = 0;
+    for(int lx = 0; lx < CHUNK_SIZE; lx++) {
+	for(int lz = 0; lz < CHUNK_SIZE; lz++) {
+	    int y0, y1;
+	    cloud_span(depth, lx, lz, &y0, &y1);
+	    level[lx * CHUNK_SIZE + lz] = y0 == y1 ? -1 : (face == 2 ? y1 - 1 : y0);
+	}
+    }
+    float zero[4] = {0, 0, 0, 0};
+    for(int lx = 0; lx < CHUNK_SIZE; lx++) {
+	for(int lz = 0; lz < CHUNK_SIZE;) {
+	    int y = level[lx * CHUNK_SIZE + lz];
+	    if(y < 0) {
+		lz++;
+		continue;
+	    }
+	    int w = 1;
+	    while(lz + w < CHUNK_SIZE && level[lx * CHUNK_SIZE + lz + w] == y) {
+		w++;
+	    }
+	    int h = 1;
+	    for(; lx + h < CHUNK_SIZE; h++) {
+		int k = 0;
+		while(k < w && level[(lx + h) * CHUNK_SIZE + lz + k] == y) {
+		    k++;
+		}
+		if(k < w) {
+		    break;
+		}
+	    }
+	    for(int a = 0; a < h; a++) {
+		for(int b = 0; b < w; b++) {
+		    level[(lx + a) * CHUNK_SIZE + lz + b] = -1;
+		}
+	    }
+	    make_cube_quad(data + faces * MESH_FACE_WORDS, zero, zero, face, tile, lx, y, lz, h, 1, w);
+	    faces++;
+	    lz += w;
+	}
+    }
+    return faces;
+}
+
+// Sides facing (dx, dz), runs along the side with the same exposed span
+// are merged into one quad
+static int cloud_sides(uint32_t *data, const unsigned char *depth, int face, int tile, int dx, int dz) {
+    float zero[4] = {0, 0, 0, 0};
+    int faces = 0;
+    for(int i = 0; i < CHUNK_SIZE; i++) {
+	for(int k = 0; k < 2; k++) {
+	    for(int j = 0; j < CHUNK_SIZE;) {
+		int lx = dx ? i : j;
+		int lz = dx ? j : i;
+		int y0, y1;
+		cloud_side(depth, lx, lz, dx, dz, k, &y0, &y1);
+		if(y0 >= y1) {
+		    j++;
+		    continue;
+		}
+		int n = 1;
+		while(j + n < CHUNK_SIZE) {
+		    int n0, n1;
+		    cloud_side(depth, dx ? i : j + n, dx ? j + n : i, dx, dz, k, &n0, &n1);
+		    if(n0 != y0 || n1 != y1) {
+			break;
+		    }
+		    n++;
+		}
+		make_cube_quad(data + faces * MESH_FACE_WORDS, zero, zero, face, tile,
+			       lx, y0, lz, dx ? 1 : n, y1 - y0, dx ? n : 1);
+		faces++;
+		j += n;
+	    }
+	}
+    }
+    return faces;
+}
+
+// Heightfield mesh of the clouds over one chunk from the field that
+// cloud_field filled in
+void cloud_mesh(Mesh *mesh, const unsigned char *depth) {
+    static const int sides[4][3] = {{0, -1, 0}, {1, 1, 0}, {4, 0, -1}, {5, 0, 1}};
+    int capacity = CHUNK_SIZE * CHUNK_SIZE * 10;
+    uint32_t *data = (uint32_t*)malloc(sizeof(uint32_t) * MESH_FACE_WORDS * capacity);
+    int faces = 0;
+    faces += cloud_caps(data + faces * MESH_FACE_WORDS, depth, 2, blocks[CLOUD][2]);
+    faces += cloud_caps(data + faces * MESH_FACE_WORDS, depth, 3, blocks[CLOUD][3]);
+    for(int i = 0; i < 4; i++) {
+	faces += cloud_sides(data + faces * MESH_FACE_WORDS, depth, sides[i][0],
+			     blocks[CLOUD][sides[i][0]], sides[i][1], sides[i][2]);
+    }
+    // The block shader discards clouds in the ortho view
+    mesh->faces = faces;
+    mesh->cutout = faces;
+    mesh->miny = CLOUD_MIDDLE - CLOUD_THICKNESS / 2;
+    mesh->maxy = mesh->miny + CLOUD_THICKNESS;
+    if(!faces) {
+	free(data);
+	mesh->data = 0;
+	return;
+    }
+    mesh->data = (uint32_t*)realloc(data, sizeof(uint32_t) * MESH_FACE_WORDS * faces);
+}
@@ -0,0 +1,23 @@
+#ifndef CLOUD_H
+#define CLOUD_H
+
+#include "mesh.h"
+#include "region.h"
+
+#define CLOUD_MIDDLE 68
+#define CLOUD_THICKNESS 8
+#define CLOUD_SIZE (CHUNK_SIZE + 2)
+
+
+// The cloud layer is a 2D field kept out of the block world, each column
+// holds a puff of up to CLOUD_THICKNESS blocks centered on CLOUD_MIDDLE.
+// The thickness is kept with the other columns of the region cache,
+// depth gets it for the columns of chunk (p, q) and the ring around it,
+// CLOUD_SIZE * CLOUD_SIZE entries with 0 for clear sky.
+void cloud_region(Region *region);
+
+void cloud_field(unsigned char *depth, int p, int q);
+
+void cloud_mesh(Mesh *mesh, const unsigned char *depth);
+
+#endif
@@ -8,6 +8,7 @@
 #define HEIGHT 768
 #define VSYNC 1
 #define INVERT_MOUSE 0
+#define PROFILE 0		// Record profiler zones, F3 writes them to profile.json
 
 // Rendering options
 #define SHOW_WIREFRAME 1
@@ -31,10 +32,23 @@
 #define CRAFT_KEY_CHAT 't'
 #define CRAFT_KEY_COMMAND '/'
 #define CRAFT_KEY_SIGN '`'
+#define CRAFT_KEY_PROFILE GLFW_KEY_F3
 
 // Advanced parameters 
 #define CREATE_CHUNK_RADIUS 10
 #define RENDER_CHUNK_RADIUS 10
+#define DELETE_CHUNK_RADIUS 14
 #define CHUNK_SIZE 32
+#define WORKER_COUNT 4
+#define MESH_UPLOAD_BUDGET (4 * 1024 * 1024)
+#define CHUNK_JOB_BUDGET 8
+#define MAX_PENDING_JOBS (WORKER_COUNT * 4)
+#define CHUNK_VIEW_WEIGHT 0.3
+#define CHUNK_MOTION_WEIGHT 0.3
+#define GREEDY_MESHING 1
+#define LIGHT_STEP_BUDGET 20000
+#define FRAME_BUDGET 16.7	// Milliseconds, frames past it count as over
+#define FLY_SECONDS 60		// Length of the mycraft -f fly-through
+#define FLY_SPEED 30		// Blocks per second
 
 #endif
@@ -1,10 +1,64 @@
 #include "cube.h"
 #include "item.h"
-#include "matrix.h"
 #include "util.h"
 
 
-void make_cube_faces(float *data,
+static const float cube_positions[6][4][3] = {
+    {{-1, -1, -1}, {-1, -1, +1}, {-1, +1, -1}, {-1, +1, +1}},
+    {{+1, -1, -1}, {+1, -1, +1}, {+1, +1, -1}, {+1, +1, +1}},
+    {{-1, +1, -1}, {-1, +1, +1}, {+1, +1, -1}, {+1, +1, +1}},
+    {{-1, -1, -1}, {-1, -1, +1}, {+1, -1, -1}, {+1, -1, +1}},
+    {{-1, -1, -1}, {-1, +1, -1}, {+1, -1, -1}, {+1, +1, -1}},
+    {{-1, -1, +1}, {-1, +1, +1}, {+1, -1, +1}, {+1, +1, +1}}
+};
+static const int cube_uvs[6][4][2] = {
+    {{0, 0}, {1, 0}, {0, 1}, {1, 1}},
+    {{1, 0}, {0, 0}, {1, 1}, {0, 1}},
+    {{0, 1}, {0, 0}, {1, 1}, {1, 0}},
+    {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
+    {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
+    {{1, 0}, {1, 1}, {0, 0}, {0, 1}}
+};
+// Corner order of each quad, the shared index buffer splits a quad
+// along its first and third corner so the flipped order turns the
+// diagonal the other way
+static const int cube_corners[6][4] = {
+    {0, 1, 3, 2},
+    {0, 2, 3, 1},
+    {0, 1, 3, 2},
+    {0, 2, 3, 1},
+    {0, 1, 3, 2},
+    {0, 2, 3, 1}
+};
+static const int cube_flipped[6][4] = {
+    {1, 3, 2, 0},
+    {2, 3, 1, 0},
+    {1, 3, 2, 0},
+    {2, 3, 1, 0},
+    {1, 3, 2, 0},
+    {2, 3, 1, 0}
+};
+
+// Texture axes of each face, uv.x runs along cube_uaxis and uv.y along
+// cube_vaxis so repeated tiles of a merged quad keep their orientation
+static const int cube_uaxis[6] = {2, 2, 0, 0, 0, 0};
+static const int cube_vaxis[6] = {1, 1, 2, 2, 1, 1};
+
+
+// The 4-bit level an ao or light value is stored as in a vertex
+unsigned int cube_quantize(float value) {
+    return roundf(MAX(0, MIN(value, 1)) * 15);
+}
+
+// Quantize and pack one vertex, see the layout in cube.h
+static void cube_vertex(uint32_t *d, int x, int y, int z, int face, float ao, float light, int tile, int u, int v, int rotation) {
+    unsigned int qao = cube_quantize(ao);
+    unsigned int qlight = cube_quantize(light);
+    d[0] = x | (y << 6) | (z << 15) | (face << 21) | (qao << 24) | (qlight << 28);
+    d[1] = tile | (u << 8) | (v << 17) | ((unsigned int)rotation << 26);
+}
+
+void make_cube_faces(uint32_t *data,
 		     float ao[6][4],
 		     float light[6][4], 
 		     int left,
@@ -19,56 +73,11 @@ void make_cube_faces(float *data,
 		     int wbottom,
 		     int wfront,
 		     int wback,
-		     float x,
-		     float y,
-		     float z,
-		     float n)
+		     int x,
+		     int y,
+		     int z)
 {
-    static const float positions[6][4][3] = {
-        {{-1, -1, -1}, {-1, -1, +1}, {-1, +1, -1}, {-1, +1, +1}},
-        {{+1, -1, -1}, {+1, -1, +1}, {+1, +1, -1}, {+1, +1, +1}},
-        {{-1, +1, -1}, {-1, +1, +1}, {+1, +1, -1}, {+1, +1, +1}},
-        {{-1, -1, -1}, {-1, -1, +1}, {+1, -1, -1}, {+1, -1, +1}},
-        {{-1, -1, -1}, {-1, +1, -1}, {+1, -1, -1}, {+1, +1, -1}},
-        {{-1, -1, +1}, {-1, +1, +1}, {+1, -1, +1}, {+1, +1, +1}}
-    };
-    static const float normals[6][3] = {
-        {-1, 0, 0},
-        {+1, 0, 0},
-        {0, +1, 0},
-        {0, -1, 0},
-        {0, 0, -1},
-        {0, 0, +1}
-    };
-    static const float uvs[6][4][2] = {
-        {{0, 0}, {1, 0}, {0, 1}, {1, 1}},
-        {{1, 0}, {0, 0}, {1, 1}, {0, 1}},
-        {{0, 1}, {0, 0}, {1, 1}, {1, 0}},
-        {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
-        {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
-        {{1, 0}, {1, 1}, {0, 0}, {0, 1}}
-    };
-    static const float indices[6][6] = {
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3},
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3},
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3}
-    };
-    static const float flipped[6][6] = {
-        {0, 1, 2, 1, 3, 2},
-        {0, 2, 1, 2, 3, 1},
-        {0, 1, 2, 1, 3, 2},
-        {0, 2, 1, 2, 3, 1},
-        {0, 1, 2, 1, 3, 2},
-        {0, 2, 1, 2, 3, 1}
-    };
-
-    float *d = data;
-    float s = 0.0625;
-    float a = 0 + 1 / 2048.0;
-    float b = s - 1 / 2048.0;
+    uint32_t *d = data;
     int faces[6] = {  left,  right,  top,  bottom,  front,  back };
     int tiles[6] = { wleft, wright, wtop, wbottom, wfront, wback };
     
@@ -76,26 +85,43 @@ void make_cube_faces(float *data,
 	if(faces[i] == 0) {
 	    continue;
 	}
-	float du = (tiles[i] % 16) * s;
-	float dv = (tiles[i] / 16) * s;
-	int flip = ao[i][0] + ao[i][3] > ao[i][1] + ao[i][2];
-	for(int v = 0; v < 6; v++) {
-	    int j = flip ? flipped[i][v] : indices[i][v];
-	    *(d++) = x + n * positions[i][j][0];
-	    *(d++) = y + n * positions[i][j][1];
-	    *(d++) = z + n * positions[i][j][2];
-	    *(d++) = normals[i][0];
-	    *(d++) = normals[i][1];
-	    *(d++) = normals[i][2];
-	    *(d++) = du + (uvs[i][j][0] ? b : a);
-	    *(d++) = dv + (uvs[i][j][1] ? b : a);
-	    *(d++) = ao[i][j];
-	    *(d++) = light[i][j];
+	make_cube_quad(d, ao[i], light[i], i, tiles[i], x, y, z, 1, 1, 1);
+	d += 4 * CUBE_VERTEX_WORDS;
+    }
+}
+
+// One face of a box of sx * sy * sz blocks whose lowest block is at the
+// chunk local position (x, y, z), the tile repeats once per block
+void make_cube_quad(uint32_t *data,
+		    float ao[4],
+		    float light[4],
+		    int face,
+		    int tile,
+		    int x,
+		    int y,
+		    int z,
+		    int sx,
+		    int sy,
+		    int sz)
+{
+    uint32_t *d = data;
+    int origin[3] = { x, y, z };
+    int size[3] = { sx, sy, sz };
+    int flip = ao[0] + ao[3] > ao[1] + ao[2];
+    for(int v = 0; v < 4; v++) {
+	int j = flip ? cube_flipped[face][v] : cube_corners[face][v];
+	int corner[3];
+	for(int k = 0; k < 3; k++) {
+	    corner[k] = origin[k] + (cube_positions[face][j][k] < 0 ? 0 : size[k]);
 	}
+	int tu = cube_uvs[face][j][0] * size[cube_uaxis[face]];
+	int tv = cube_uvs[face][j][1] * size[cube_vaxis[face]];
+	cube_vertex(d, corner[0], corner[1], corner[2], face, ao[j], light[j], tile, tu, tv, 0);
+	d += CUBE_VERTEX_WORDS;
     }
 }
 
-void make_cube(float *data,
+void make_cube(uint32_t *data,
 	       float ao[6][4],
 	       float light[6][4], 
 	       int left,
@@ -104,10 +130,9 @@ void make_cube(float *data,
 	       int bottom,
 	       int front,
 	       int back,
-	       float x,
-	       float y,
-	       float z,
-	       float n,
+	       int x,
+	       int y,
+	       int z,
 	       int w)
 {
     int wleft   = blocks[w][0];
@@ -117,73 +142,53 @@ void make_cube(float *data,
     int wfront  = blocks[w][4];
     int wback   = blocks[w][5];
 
-    make_cube_faces(data, ao, light, left, right, top, bottom, front, back, wleft, wright, wtop, wbottom, wfront, wback, x, y, z, n);
+    make_cube_faces(data, ao, light, left, right, top, bottom, front, back, wleft, wright, wtop, wbottom, wfront, wback, x, y, z);
 }
 
-void make_plant(float *data,
+// The four quads of a plant are spun around the block center by block.vs,
+// u carries the quad index above the corner bit
+void make_plant(uint32_t *data,
 		float ao,
 		float light,
-		float px,
-		float py,
-		float pz,
-		float n,
+		int x,
+		int y,
+		int z,
 		int w,
 		float rotation)
 {
-    static const float positions[4][4][3] = {
-        {{ 0, -1, -1}, { 0, -1, +1}, { 0, +1, -1}, { 0, +1, +1}},
-        {{ 0, -1, -1}, { 0, -1, +1}, { 0, +1, -1}, { 0, +1, +1}},
-        {{-1, -1,  0}, {-1, +1,  0}, {+1, -1,  0}, {+1, +1,  0}},
-        {{-1, -1,  0}, {-1, +1,  0}, {+1, -1,  0}, {+1, +1,  0}}
-    };
-    static const float normals[4][3] = {
-        {-1, 0, 0},
-        {+1, 0, 0},
-        {0, 0, -1},
-        {0, 0, +1}
-    };
-    static const float uvs[4][4][2] = {
+    static const int uvs[4][4][2] = {
         {{0, 0}, {1, 0}, {0, 1}, {1, 1}},
         {{1, 0}, {0, 0}, {1, 1}, {0, 1}},
         {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
         {{1, 0}, {1, 1}, {0, 0}, {0, 1}}
     };
-    static const float indices[4][6] = {
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3},
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3}
+    static const int corners[4][4] = {
+        {0, 1, 3, 2},
+        {0, 2, 3, 1},
+        {0, 1, 3, 2},
+        {0, 2, 3, 1}
     };
-    float *d = data;
-    float s = 0.0625;
-    float a = 0;
-    float b = s;
-    float du = (plants[w] % 16) * s;
-    float dv = (plants[w] / 16) * s;
+    uint32_t *d = data;
+    int steps = (int)roundf(rotation / 360 * 64) & 63;
     for (int i = 0; i < 4; i++) {
-        for (int v = 0; v < 6; v++) {
-            int j = indices[i][v];
-            *(d++) = n * positions[i][j][0];
-            *(d++) = n * positions[i][j][1];
-            *(d++) = n * positions[i][j][2];
-            *(d++) = normals[i][0];
-            *(d++) = normals[i][1];
-            *(d++) = normals[i][2];
-            *(d++) = du + (uvs[i][j][0] ? b : a);
-            *(d++) = dv + (uvs[i][j][1] ? b : a);
-            *(d++) = ao;
-            *(d++) = light;
+        for (int v = 0; v < 4; v++) {
+            int j = corners[i][v];
+	    int tu = (i << 1) | uvs[i][j][0];
+	    cube_vertex(d, x, y, z, CUBE_PLANT_FACE, ao, light, plants[w], tu, uvs[i][j][1], steps);
+	    d += CUBE_VERTEX_WORDS;
         }
     }
-    float ma[16];
-    float mb[16];
-    mat_identity(ma);
-    mat_rotate(mb, 0, 1, 0, RADIANS(rotation));
-    mat_multiply(ma, mb, ma);
-    mat_apply(data, ma, 24, 3, 10);
-    mat_translate(mb, px, py, pz);
-    mat_multiply(ma, mb, ma);
-    mat_apply(data, ma, 24, 0, 10);
+}
+
+// Two triangles per quad of four vertices, shared by every chunk
+void make_quad_indices(uint32_t *data, int count) {
+    static const int pattern[6] = {0, 1, 2, 0, 2, 3};
+    uint32_t *d = data;
+    for(int i = 0; i < count; i++) {
+	for(int j = 0; j < 6; j++) {
+	    *(d++) = i * 4 + pattern[j];
+	}
+    }
 }
 
 void make_cube_wireframe(float *data,
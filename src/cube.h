@@ -2,9 +2,18 @@
 #define CUBE_H
 
 #include <math.h>
+#include <stdint.h>
 
+// Chunk vertices are packed into two words:
+//   x:6 y:9 z:6 face:3 ao:4 light:4, positions are chunk local corners
+//   tile:8 u:9 v:9 rotation:6, u and v count tiles across the quad
+#define CUBE_VERTEX_WORDS 2
+#define CUBE_PLANT_FACE 6
 
-void make_cube_faces(float *data,
+
+unsigned int cube_quantize(float value);
+
+void make_cube_faces(uint32_t *data,
 		     float ao[6][4],
 		     float light[6][4], 
 		     int left,
@@ -19,12 +28,23 @@ void make_cube_faces(float *data,
 		     int wbottom,
 		     int wfront,
 		     int wback,
-		     float x,
-		     float y,
-		     float z,
-		     float n);
+		     int x,
+		     int y,
+		     int z);
 
-void make_cube(float *data,
+void make_cube_quad(uint32_t *data,
+		    float ao[4],
+		    float light[4],
+		    int face,
+		    int tile,
+		    int x,
+		    int y,
+		    int z,
+		    int sx,
+		    int sy,
+		    int sz);
+
+void make_cube(uint32_t *data,
 	       float ao[6][4],
 	       float light[6][4], 
 	       int left,
@@ -33,22 +53,22 @@ void make_cube(float *data,
 	       int bottom,
 	       int front,
 	       int back,
-	       float x,
-	       float y,
-	       float z,
-	       float n,
+	       int x,
+	       int y,
+	       int z,
 	       int w);
 
-void make_plant(float *data,
+void make_plant(uint32_t *data,
 		float ao,
 		float light,
-		float px,
-		float py,
-		float pz,
-		float n,
+		int x,
+		int y,
+		int z,
 		int w,
 		float rotation);
 
+void make_quad_indices(uint32_t *data, int count);
+
 void make_cube_wireframe(float *data,
 			 float x,
 			 float y,
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "light.h"
+
+
+static const int light_offsets[6][3] = {
+    {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}
+};
+
+static void light_queue_push(LightQueue *queue, int x, int y, int z, int w) {
+    if(queue->count == queue->capacity) {
+	int capacity = queue->capacity ? queue->capacity * 2 : 1024;
+	LightNode *data = (LightNode*)malloc(sizeof(LightNode) * capacity);
+	for(int i = 0; i < queue->count; i++) {
+	    data[i] = queue->data[(queue->head + i) % queue->capacity];
+	}
+	free(queue->data);
+	queue->data = data;
+	queue->head = 0;
+	queue->capacity = capacity;
+    }
+    LightNode *node = queue->data + (queue->head + queue->count) % queue->capacity;
+    node->x = x;
+    node->y = y;
+    node->z = z;
+    node->w = w;
+    queue->count++;
+}
+
+static LightNode light_queue_pop(LightQueue *queue) {
+    LightNode node = queue->data[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    return node;
+}
+
+void light_init(LightEngine *engine, light_get_func get, light_set_func set, light_open_func open, void *arg) {
+    memset(engine, 0, sizeof(LightEngine));
+    engine->get = get;
+    engine->set = set;
+    engine->open = open;
+    engine->arg = arg;
+}
+
+void light_free(LightEngine *engine) {
+    free(engine->adds.data);
+    free(engine->removes.data);
+    memset(&engine->adds, 0, sizeof(LightQueue));
+    memset(&engine->removes, 0, sizeof(LightQueue));
+}
+
+void light_add_source(LightEngine *engine, int x, int y, int z) {
+    engine->set(x, y, z, LIGHT_SOURCE, engine->arg);
+    light_queue_push(&engine->adds, x, y, z, LIGHT_SOURCE);
+}
+
+// Darkens (x, y, z) and everything that was lit through it
+void light_remove(LightEngine *engine, int x, int y, int z) {
+    int w = engine->get(x, y, z, engine->arg);
+    if(!w) {
+	return;
+    }
+    engine->set(x, y, z, 0, engine->arg);
+    light_queue_push(&engine->removes, x, y, z, w);
+}
+
+// Spreads the light already at (x, y, z) to its neighbors
+void light_seed(LightEngine *engine, int x, int y, int z) {
+    int w = engine->get(x, y, z, engine->arg);
+    if(w > 1) {
+	light_queue_push(&engine->adds, x, y, z, w);
+    }
+}
+
+// Lets the neighbors of a block that just opened up light it
+void light_refill(LightEngine *engine, int x, int y, int z) {
+    for(int i = 0; i < 6; i++) {
+	light_seed(engine, x + light_offsets[i][0], y + light_offsets[i][1], z + light_offsets[i][2]);
+    }
+}
+
+// Processes up to budget queued blocks, returns how many are left
+int light_update(LightEngine *engine, int budget) {
+    void *arg = engine->arg;
+    while(budget > 0 && engine->removes.count) {
+	LightNode node = light_queue_pop(&engine->removes);
+	budget--;
+	for(int i = 0; i < 6; i++) {
+	    int x = node.x + light_offsets[i][0];
+	    int y = node.y + light_offsets[i][1];
+	    int z = node.z + light_offsets[i][2];
+	    if(y < 0 || y > 255) {
+		continue;
+	    }
+	    int w = engine->get(x, y, z, arg);
+	    if(w && w < node.w) {
+		engine->set(x, y, z, 0, arg);
+		light_queue_push(&engine->removes, x, y, z, w);
+	    }
+	    else if(w >= node.w) {
+		// Lit from elsewhere, it refills the cleared blocks
+		light_queue_push(&engine->adds, x, y, z, w);
+	    }
+	}
+    }
+    while(budget > 0 && !engine->removes.count && engine->adds.count) {
+	LightNode node = light_queue_pop(&engine->adds);
+	budget--;
+	// The level may have changed since the block was queued
+	int w = engine->get(node.x, node.y, node.z, arg);
+	if(w <= 1) {
+	    continue;
+	}
+	for(int i = 0; i < 6; i++) {
+	    int x = node.x + light_offsets[i][0];
+	    int y = node.y + light_offsets[i][1];
+	    int z = node.z + light_offsets[i][2];
+	    if(y < 0 || y > 255) {
+		continue;
+	    }
+	    if(!engine->open(x, y, z, arg)) {
+		continue;
+	    }
+	    if(engine->get(x, y, z, arg) < w - 1) {
+		engine->set(x, y, z, w - 1, arg);
+		light_queue_push(&engine->adds, x, y, z, w - 1);
+	    }
+	}
+    }
+    return light_pending(engine);
+}
+
+int light_pending(LightEngine *engine) {
+    return engine->adds.count + engine->removes.count;
+}
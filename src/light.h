@@ -0,0 +1,58 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#define LIGHT_SOURCE 15
+
+
+typedef int (*light_get_func)(int x, int y, int z, void *arg);
+
+typedef void (*light_set_func)(int x, int y, int z, int w, void *arg);
+
+// Non zero when light can pass through the block at (x, y, z)
+typedef int (*light_open_func)(int x, int y, int z, void *arg);
+
+typedef struct {
+    int x;
+    int y;
+    int z;
+    int w;
+} LightNode;
+
+typedef struct {
+    LightNode *data;
+    int head;
+    int count;
+    int capacity;
+} LightQueue;
+
+// Breadth first block light. A level drops by one per block and only
+// LIGHT_SOURCE blocks hold the top level. Removals are drained before
+// additions so a darkened region is cleared before its borders refill it.
+typedef struct {
+    LightQueue adds;
+    LightQueue removes;
+    light_get_func get;
+    light_set_func set;
+    light_open_func open;
+    void *arg;
+} LightEngine;
+
+
+void light_init(LightEngine *engine, light_get_func get, light_set_func set, light_open_func open, void *arg);
+
+void light_free(LightEngine *engine);
+
+void light_add_source(LightEngine *engine, int x, int y, int z);
+
+void light_remove(LightEngine *engine, int x, int y, int z);
+
+void light_seed(LightEngine *engine, int x, int y, int z);
+
+void light_refill(LightEngine *engine, int x, int y, int z);
+
+int light_update(LightEngine *engine, int budget);
+
+int light_pending(LightEngine *engine);
+
+
+#endif
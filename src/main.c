@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
 
@@ -10,25 +11,57 @@
 #include "util.h"
 #include "matrix.h"
 #include "map.h"
+#include "chunk_map.h"
+#include "chunk_index.h"
+#include "worker.h"
 #include "world.h"
+#include "region.h"
 #include "item.h"
 #include "cube.h"
+#include "mesh.h"
+#include "light.h"
+#include "sky.h"
+#include "cloud.h"
+#include "profile.h"
+#include "arena.h"
 
 #define MAX_CHUNKS 8192
 #define MAX_PLAYERS 128
 #define MAX_NAME_LENGTH 32
+#define ARENA_PAGE 64		// Faces per page of the mesh arena
+#define ARENA_PAGE_BYTES (sizeof(uint32_t) * MESH_FACE_WORDS * ARENA_PAGE)
+#define ARENA_PAGES 4096	// Pages the mesh arena starts with
+#define STREAM_FRAMES 3		// Frames the stream buffer may have in flight
+#define STREAM_FRAME_BYTES (64 * 1024)
+#define BLOCK_VERTEX 0		// Location of the packed vertex in block.vs
 
 
+// SECTION_HEIGHT rows of a chunk with their own mesh
 typedef struct {
-    Map map;
+    int faces;
+    int miny;
+    int maxy;
+    int cutout;			// Faces at the start that need alpha testing
+    int page;			// First page in the mesh arena
+} Section;
+
+typedef struct Chunk {
+    ChunkMap map;
     Map lights;
+    SkyMap sky;
     int p;
     int q;
     int faces;
-    int dirty;
+    unsigned int dirty;		// One bit per section
+    int ready;
+    Job *job;
     int miny;
     int maxy;
-    GLuint buffer;
+    Section sections[CHUNK_SECTIONS];
+    Section clouds;		// The cloud layer over the chunk
+    unsigned int serial;
+    int index;
+    struct Chunk *neighbors[3][3];
 } Chunk;
 
 typedef struct {
@@ -38,6 +71,11 @@ typedef struct {
     int w;
 } Block;
 
+typedef struct {
+    float distance;
+    Chunk *chunk;
+} ChunkDraw;
+
 typedef struct {
     float x;
     float y;
@@ -69,17 +107,63 @@ typedef struct {
     GLuint extra2;
     GLuint extra3;
     GLuint extra4;
+    GLuint extra5;
+    GLuint extra6;
 } Attrib;
 
+// Every section mesh lives in one vertex buffer, in runs of ARENA_PAGE
+// faces. block.vs finds the chunk of a vertex from its page through the
+// page table, a buffer texture, so any set of sections is one draw.
+typedef struct {
+    Arena arena;
+    GLuint vao;
+    GLuint buffer;
+    GLuint page_buffer;
+    GLuint page_texture;
+    int *pages;			// Chunk p and q of each page
+    GLsizei *counts;		// Sections queued by draw_chunk
+    GLint *bases;
+    const GLvoid **indices;
+    int draw_count;
+} MeshArena;
+
+// Geometry that only lives for one frame, written into the part of one
+// buffer that belongs to the frame. A fence on each part keeps it from
+// being written again before the GPU has drawn that frame.
+typedef struct {
+    GLuint buffer;
+    int frame;
+    int offset;
+    GLsync fences[STREAM_FRAMES];
+} Stream;
+
 typedef struct {
     GLFWwindow *window;
     int width;
     int height;
-    Chunk chunks[MAX_CHUNKS];
+    Chunk chunk_pool[MAX_CHUNKS];
+    Chunk *free_chunks[MAX_CHUNKS];
+    int free_count;
+    int pool_count;
+    Chunk *chunks[MAX_CHUNKS];
     int chunk_count;
+    ChunkDraw visible[MAX_CHUNKS];
+    unsigned int chunk_serial;
+    ChunkIndex chunk_index;
+    WorkerPool workers;
+    Job *uploads;
+    Job *uploads_tail;
+    GLuint quad_indices;
+    int quad_capacity;
+    MeshArena arena;
+    Stream stream;
+    LightEngine light;
+    LightEngine sky;
     int create_radius;
     int render_radius;
-    // int delete_radius;
+    int delete_radius;
+    float vx;
+    float vz;
     Player players[MAX_PLAYERS];
     int player_count;
     int observe1;
@@ -92,6 +176,12 @@ typedef struct {
     float fov;
     int day_length;
     int time_changed;
+    double fly_seconds;
+    double fly_start;
+    int fly_frames;
+    int fly_over;
+    double fly_p99;
+    double fly_max;
 
 } Model;
 
@@ -139,79 +229,110 @@ void get_motion_vector(int flying, int sz, int sx, float rx, float ry, float *vx
     }
 }
 
-GLuint gen_wireframe_buffer(float x, float y , float z, float n) {
-    float data[72];
-    make_cube_wireframe(data, x, y, z, n);
-    return gen_buffer(sizeof(data), data);
+void stream_init() {
+    Stream *stream = &g->stream;
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    glBufferData(GL_ARRAY_BUFFER, STREAM_FRAME_BYTES * STREAM_FRAMES, 0, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stream->frame = 0;
+    stream->offset = 0;
+    memset(stream->fences, 0, sizeof(stream->fences));
 }
 
-void draw_triangles_3d_ao(Attrib *attrib, GLuint buffer, int count) {
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glEnableVertexAttribArray(attrib->position);
-    glEnableVertexAttribArray(attrib->normal);
-    glEnableVertexAttribArray(attrib->uv);
-    glVertexAttribPointer(attrib->position, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 10, (void*)0);
-    glVertexAttribPointer(attrib->normal,   3, GL_FLOAT, GL_FALSE, sizeof(float) * 10, (void*)(sizeof(float) * 3));
-    glVertexAttribPointer(attrib->uv,       4, GL_FLOAT, GL_FALSE, sizeof(float) * 10, (void*)(sizeof(float) * 6));
-    glDrawArrays(GL_TRIANGLES, 0, count);
-    glDisableVertexAttribArray(attrib->position);
-    glDisableVertexAttribArray(attrib->normal);
-    glDisableVertexAttribArray(attrib->uv);
+void stream_free() {
+    Stream *stream = &g->stream;
+    for(int i = 0; i < STREAM_FRAMES; i++) {
+	glDeleteSync(stream->fences[i]);
+    }
+    glDeleteBuffers(1, &stream->buffer);
+}
+
+// Copies size bytes into the part of the current frame and returns their
+// offset in the buffer, or -1 once the part is full
+int stream_write(const void *data, int size) {
+    Stream *stream = &g->stream;
+    if(stream->offset + size > STREAM_FRAME_BYTES) {
+	return -1;
+    }
+    int offset = stream->frame * STREAM_FRAME_BYTES + stream->offset;
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    // Nothing in flight uses this part, stream_frame waited for it
+    void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+				 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    memcpy(dst, data, size);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stream->offset += (size + 15) & ~15;
+    return offset;
 }
 
-void draw_lines(Attrib *attrib, GLuint buffer, int components, int count) {
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(attrib->position, components, GL_FLOAT, GL_FALSE, 0, (void*)0);
+// Fences the draws of the frame that ends and moves on to the next part,
+// waiting if the GPU still has the frame that last wrote it in flight
+void stream_frame() {
+    Stream *stream = &g->stream;
+    glDeleteSync(stream->fences[stream->frame]);
+    stream->fences[stream->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    stream->frame = (stream->frame + 1) % STREAM_FRAMES;
+    stream->offset = 0;
+    GLsync fence = stream->fences[stream->frame];
+    if(fence) {
+	PROFILE_BEGIN("stream_wait");
+	while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+	PROFILE_END();
+	glDeleteSync(fence);
+	stream->fences[stream->frame] = 0;
+    }
+}
+
+// Draws count vertices written at offset in the stream buffer
+void draw_lines(Attrib *attrib, int offset, int components, int count) {
+    glBindBuffer(GL_ARRAY_BUFFER, g->stream.buffer);
+    glEnableVertexAttribArray(attrib->position);
+    glVertexAttribPointer(attrib->position, components, GL_FLOAT, GL_FALSE, 0, (void*)(intptr_t)offset);
     glDrawArrays(GL_LINES, 0, count);
     glDisableVertexAttribArray(attrib->position);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void draw_chunk(Attrib *attrib, Chunk *chunk) {
-    draw_triangles_3d_ao(attrib, chunk->buffer, chunk->faces * 6);
-}
-
-void occlusion(char neighbors[27], char lights[27], float shades[27], float ao[6][4], float light[6][4]) {
-    static const int lookup3[6][4][3] = {
-        {{0, 1, 3}, {2, 1, 5}, {6, 3, 7}, {8, 5, 7}},
-        {{18, 19, 21}, {20, 19, 23}, {24, 21, 25}, {26, 23, 25}},
-        {{6, 7, 15}, {8, 7, 17}, {24, 15, 25}, {26, 17, 25}},
-        {{0, 1, 9}, {2, 1, 11}, {18, 9, 19}, {20, 11, 19}},
-        {{0, 3, 9}, {6, 3, 15}, {18, 9, 21}, {24, 15, 21}},
-        {{2, 5, 11}, {8, 5, 17}, {20, 11, 23}, {26, 17, 23}}
-    };
-   static const int lookup4[6][4][4] = {
-        {{0, 1, 3, 4}, {1, 2, 4, 5}, {3, 4, 6, 7}, {4, 5, 7, 8}},
-        {{18, 19, 21, 22}, {19, 20, 22, 23}, {21, 22, 24, 25}, {22, 23, 25, 26}},
-        {{6, 7, 15, 16}, {7, 8, 16, 17}, {15, 16, 24, 25}, {16, 17, 25, 26}},
-        {{0, 1, 9, 10}, {1, 2, 10, 11}, {9, 10, 18, 19}, {10, 11, 19, 20}},
-        {{0, 3, 9, 12}, {3, 6, 12, 15}, {9, 12, 18, 21}, {12, 15, 21, 24}},
-        {{2, 5, 11, 14}, {5, 8, 14, 17}, {11, 14, 20, 23}, {14, 17, 23, 26}}
-    };
-    static const float curve[4] = {0.0, 0.25, 0.5, 0.75};
-    for (int i = 0; i < 6; i++) {
-        for (int j = 0; j < 4; j++) {
-            int corner = neighbors[lookup3[i][j][0]];
-            int side1 = neighbors[lookup3[i][j][1]];
-            int side2 = neighbors[lookup3[i][j][2]];
-            int value = side1 && side2 ? 3 : corner + side1 + side2;
-            float shade_sum = 0;
-            float light_sum = 0;
-            int is_light = lights[13] == 15;
-            for (int k = 0; k < 4; k++) {
-                shade_sum += shades[lookup4[i][j][k]];
-                light_sum += lights[lookup4[i][j][k]];
-            }
-            if (is_light) {
-                light_sum = 15 * 4 * 10;
-            }
-            float total = curve[value] + shade_sum / 4.0;
-            ao[i][j] = MIN(total, 1.0);
-            light[i][j] = light_sum / 15.0 / 4.0;
-        }
+// Queues the cut-out or the opaque faces of the section
+void draw_section(Section *section, int cutout) {
+    MeshArena *arena = &g->arena;
+    if(section->faces <= 0) {
+	return;
+    }
+    int first = cutout ? 0 : section->cutout;
+    int faces = cutout ? section->cutout : section->faces - section->cutout;
+    if(faces > 0) {
+	arena->counts[arena->draw_count] = faces * 6;
+	arena->bases[arena->draw_count] = (section->page * ARENA_PAGE + first) * 4;
+	arena->draw_count++;
+    }
+}
+
+// Queues the sections of the chunk for the next draw_sections, from the
+// one at height y outwards
+void draw_chunk(Chunk *chunk, int cutout, int y) {
+    int below = MAX(0, MIN(CHUNK_SECTIONS - 1, y / SECTION_HEIGHT));
+    int above = below + 1;
+    while(below >= 0 || above < CHUNK_SECTIONS) {
+	if(below >= 0) {
+	    draw_section(chunk->sections + below--, cutout);
+	}
+	if(above < CHUNK_SECTIONS) {
+	    draw_section(chunk->sections + above++, cutout);
+	}
     }
+    draw_section(&chunk->clouds, cutout);
+}
+
+void draw_sections() {
+    MeshArena *arena = &g->arena;
+    glBindVertexArray(arena->vao);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, arena->counts, GL_UNSIGNED_INT,
+				  arena->indices, arena->draw_count, arena->bases);
+    glBindVertexArray(0);
+    arena->draw_count = 0;
 }
 
 int chunked(float x) {
@@ -219,55 +340,243 @@ int chunked(float x) {
 }
 
 Chunk* find_chunk(int p, int q) {
-    for(int i = 0; i < g->chunk_count; i++) {
-	Chunk *chunk = g->chunks + i;
-	if(chunk->p == p && chunk->q == q) {
-	    return chunk;
+    return (Chunk*)chunk_index_get(&g->chunk_index, p, q);
+}
+
+void link_chunk(Chunk *chunk) {
+    chunk_index_set(&g->chunk_index, chunk->p, chunk->q, chunk);
+    for(int dp = -1; dp <= 1; dp++) {
+	for(int dq = -1; dq <= 1; dq++) {
+	    Chunk *other = chunk;
+	    if(dp || dq) {
+		other = find_chunk(chunk->p + dp, chunk->q + dq);
+	    }
+	    chunk->neighbors[dp + 1][dq + 1] = other;
+	    if(other) {
+		other->neighbors[1 - dp][1 - dq] = chunk;
+	    }
 	}
     }
-    return 0;
+}
+
+// Marks the section holding y and the section across the nearest
+// vertical boundary when y sits on it, their faces and shading see it
+void dirty_block(Chunk *chunk, int y) {
+    int section = y / SECTION_HEIGHT;
+    chunk->dirty |= 1u << section;
+    if(y % SECTION_HEIGHT == 0 && section > 0) {
+	chunk->dirty |= 1u << (section - 1);
+    }
+    if(y % SECTION_HEIGHT == SECTION_HEIGHT - 1 && section < CHUNK_SECTIONS - 1) {
+	chunk->dirty |= 1u << (section + 1);
+    }
 }
 
 void _set_block(int p, int q, int x, int y, int z, int w, int dirty) {
     Chunk *chunk = find_chunk(p, q);
-    if(chunk) {
-	Map *map = &chunk->map;
-	if(map_set(map, x, y, z, w)) {
+    if(chunk && chunk->ready) {
+	ChunkMap *map = &chunk->map;
+	if(chunk_map_set(map, x, y, z, w)) {
 	    if(dirty) {
-		chunk->dirty = 1;	// @Change
-		// dirty_block(chunk);
+		dirty_block(chunk, y);
 	    }
 	}
     }
 }
 
-void set_block(int x, int y, int z, int w) {
+// Marks the chunks whose meshes read the block at (x, y, z), its own
+// and the ones that keep it in their ring
+void dirty_chunks(int x, int y, int z) {
     int p = chunked(x);
     int q = chunked(z);
-    _set_block(p, q, x, y, z, w, 1);
     for(int dx = -1; dx <= 1; dx++) {
 	for(int dz = -1; dz <= 1; dz++) {
-	    if (dx == 0 && dz == 0) {
-                continue;
-            }
-            if (dx && chunked(x + dx) == p) {
-                continue;
-            }
-            if (dz && chunked(z + dz) == q) {
-                continue;
-            }
-            _set_block(p + dx, q + dz, x, y, z, -w, 1);
+	    if(dx && chunked(x + dx) == p) {
+		continue;
+	    }
+	    if(dz && chunked(z + dz) == q) {
+		continue;
+	    }
+	    Chunk *chunk = find_chunk(p + dx, q + dz);
+	    if(chunk && chunk->ready) {
+		dirty_block(chunk, y);
+	    }
+	}
+    }
+}
+
+int chunk_light_get(int x, int y, int z, void *arg) {
+    (void)arg;
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    if(!chunk || !chunk->ready) {
+	return 0;
+    }
+    return map_get(&chunk->lights, x, y, z);
+}
+
+void chunk_light_set(int x, int y, int z, int w, void *arg) {
+    (void)arg;
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    if(!chunk || !chunk->ready) {
+	return;
+    }
+    if(map_set(&chunk->lights, x, y, z, w)) {
+	dirty_chunks(x, y, z);
+    }
+}
+
+// Light stops at opaque blocks and at chunks that are not loaded, they
+// are seeded from their neighbors once they are
+int chunk_light_open(int x, int y, int z, void *arg) {
+    (void)arg;
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    if(!chunk || !chunk->ready) {
+	return 0;
+    }
+    return is_transparent(chunk_map_get(&chunk->map, x, y, z));
+}
+
+// Keeps the block light consistent with the edit of one block
+void light_block(int x, int y, int z, int w) {
+    if(chunk_light_get(x, y, z, 0)) {
+	light_remove(&g->light, x, y, z);
+    }
+    if(is_transparent(w)) {
+	light_refill(&g->light, x, y, z);
+    }
+}
+
+// Spreads the light of the neighbors into a chunk that just loaded
+void seed_chunk_light(Chunk *chunk) {
+    int x0 = chunk->p * CHUNK_SIZE;
+    int z0 = chunk->q * CHUNK_SIZE;
+    for(int dp = -1; dp <= 1; dp++) {
+	for(int dq = -1; dq <= 1; dq++) {
+	    Chunk *other = chunk->neighbors[dp + 1][dq + 1];
+	    if(!other || other == chunk || !other->ready) {
+		continue;
+	    }
+	    Map *map = &other->lights;
+	    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+		if(ew <= 1) {
+		    continue;
+		}
+		if(ex < x0 - 1 || ex > x0 + CHUNK_SIZE || ez < z0 - 1 || ez > z0 + CHUNK_SIZE) {
+		    continue;
+		}
+		light_seed(&g->light, ex, ey, ez);
+	    } END_MAP_FOR_EACH;
+	}
+    }
+}
+
+// Takes the light of a chunk about to be deleted back out of its
+// neighbors. Its sources go with it, a reloaded chunk is generated
+// without them, so nothing may be left for seed_chunk_light to spread.
+void clear_chunk_light(Chunk *chunk) {
+    int x0 = chunk->p * CHUNK_SIZE;
+    int z0 = chunk->q * CHUNK_SIZE;
+    Map *map = &chunk->lights;
+    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+	int lx = ex - x0;
+	int lz = ez - z0;
+	if(ew && (lx == 0 || lx == CHUNK_SIZE - 1 || lz == 0 || lz == CHUNK_SIZE - 1)) {
+	    light_remove(&g->light, ex, ey, ez);
+	}
+    } END_MAP_FOR_EACH;
+}
+
+int chunk_sky_get(int x, int y, int z, void *arg) {
+    (void)arg;
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    if(!chunk || !chunk->ready) {
+	return 0;
+    }
+    return sky_get(&chunk->sky, x, y, z);
+}
+
+void chunk_sky_set(int x, int y, int z, int w, void *arg) {
+    (void)arg;
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    if(!chunk || !chunk->ready) {
+	return;
+    }
+    if(sky_set(&chunk->sky, x, y, z, w)) {
+	dirty_chunks(x, y, z);
+    }
+}
+
+// Keeps the skylight consistent with the edit of one block. The column
+// height moves first, the blocks it covers go dark through the remove
+// queue and the ones it uncovers light their surroundings.
+void sky_block(int x, int y, int z, int w) {
+    Chunk *chunk = find_chunk(chunked(x), chunked(z));
+    if(!chunk || !chunk->ready) {
+	return;
+    }
+    SkyMap *sky = &chunk->sky;
+    int before = sky_height(sky, x, z);
+    int after = sky_update_height(sky, &chunk->map, x, z);
+    for(int ey = before; ey < after; ey++) {
+	sky_set(sky, x, ey, z, SKY_LIGHT);
+	light_remove(&g->sky, x, ey, z);
+    }
+    for(int ey = after; ey < before; ey++) {
+	dirty_chunks(x, ey, z);
+	light_seed(&g->sky, x, ey, z);
+    }
+    if(y < MIN(before, after)) {
+	if(chunk_sky_get(x, y, z, 0)) {
+	    light_remove(&g->sky, x, y, z);
+	}
+	if(is_transparent(w)) {
+	    light_refill(&g->sky, x, y, z);
+	}
+    }
+}
+
+// Lets the skylight cross the seams between a chunk that just loaded and
+// its ready neighbors, both sides up to the higher of the two columns
+void seed_chunk_sky(Chunk *chunk) {
+    static const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    for(int i = 0; i < 4; i++) {
+	int dp = offsets[i][0];
+	int dq = offsets[i][1];
+	Chunk *other = chunk->neighbors[dp + 1][dq + 1];
+	if(!other || !other->ready) {
+	    continue;
+	}
+	for(int k = 0; k < CHUNK_SIZE; k++) {
+	    int lx = dp ? (dp < 0 ? 0 : CHUNK_SIZE - 1) : k;
+	    int lz = dq ? (dq < 0 ? 0 : CHUNK_SIZE - 1) : k;
+	    int x = chunk->sky.dx + lx;
+	    int z = chunk->sky.dz + lz;
+	    int top = MAX(sky_height(&chunk->sky, x, z), sky_height(&other->sky, x + dp, z + dq));
+	    for(int y = 0; y < top; y++) {
+		light_seed(&g->sky, x, y, z);
+		light_seed(&g->sky, x + dp, y, z + dq);
+	    }
 	}
     }
 }
 
+void set_block(int x, int y, int z, int w) {
+    int p = chunked(x);
+    int q = chunked(z);
+    _set_block(p, q, x, y, z, w, 1);
+    // Neighbors read the block through their mesh snapshots
+    dirty_chunks(x, y, z);
+    light_block(x, y, z, w);
+    sky_block(x, y, z, w);
+}
+
 int get_block(int x, int y, int z) {
     int p = chunked(x);
     int q = chunked(z);
     Chunk *chunk = find_chunk(p, q);
     if(chunk) {
-	Map *map = &chunk->map;
-	return map_get(map, x, y, z);
+	ChunkMap *map = &chunk->map;
+	return chunk_map_get(map, x, y, z);
     }
     return 0;
 }
@@ -280,12 +589,13 @@ int highest_block(float x, float z) {
     int q  = chunked(z);
     Chunk *chunk = find_chunk(p, q);
     if(chunk) {
-	Map *map = &chunk->map;
-	MAP_FOR_EACH(map, ex, ey, ez, ew) {
-	    if(is_obstacle(ew) && ex == nx && ez == nz) {
-		result = MAX(result, ey);
+	ChunkMap *map = &chunk->map;
+	for(int y = map->top - 1; y >= 0; y--) {
+	    if(is_obstacle(chunk_map_get(map, nx, y, nz))) {
+		result = y;
+		break;
 	    }
-	} END_MAP_FOR_EACH;
+	}
     }
     return result;
 }
@@ -296,6 +606,19 @@ int chunk_distance(Chunk *chunk, int p, int q) {
     return MAX(dp, dq);
 }
 
+// Chunks past the render radius are fogged out completely, the rest are
+// drawn when their faces may be inside the view frustum
+int chunk_visible(float planes[6][4], Chunk *chunk, int p, int q) {
+    if(chunk_distance(chunk, p, q) > g->render_radius) {
+	return 0;
+    }
+    float x = chunk->p * CHUNK_SIZE - 0.5;
+    float z = chunk->q * CHUNK_SIZE - 0.5;
+    return frustum_box(planes, 6,
+		       x, chunk->miny - 0.5, z,
+		       x + CHUNK_SIZE, chunk->maxy + 0.5, z + CHUNK_SIZE);
+}
+
 int player_intersects_block(int height, float x, float y, float z, int hx, int hy, int hz) {
     int nx = roundf(x);
     int ny = roundf(y);
@@ -316,7 +639,7 @@ int collide(int height, float *x, float *y, float *z) {
     if(!chunk) {
 	return result;
     }
-    Map *map = &chunk->map;
+    // The blocks around may belong to the neighbors
     int nx = roundf(*x);
     int ny = roundf(*y);
     int nz = roundf(*z);
@@ -325,24 +648,24 @@ int collide(int height, float *x, float *y, float *z) {
     float pz = *z - nz;
     float pad = 0.25;
     for(int dy = 0; dy < height; dy++) {
-	if(px < -pad && is_obstacle(map_get(map, nx - 1, ny - dy, nz))) {
+	if(px < -pad && is_obstacle(get_block(nx - 1, ny - dy, nz))) {
 	    *x = nx - pad;
 	}
-	if(px >  pad && is_obstacle(map_get(map, nx + 1, ny - dy, nz))) {
+	if(px >  pad && is_obstacle(get_block(nx + 1, ny - dy, nz))) {
 	    *x = nx + pad;
 	}
-	if(py < -pad && is_obstacle(map_get(map, nx, ny - dy - 1, nz))) {
+	if(py < -pad && is_obstacle(get_block(nx, ny - dy - 1, nz))) {
 	    *y = ny - pad;
 	    result = 1;
 	}
-	if(py >  pad && is_obstacle(map_get(map, nx, ny - dy + 1, nz))) {
+	if(py >  pad && is_obstacle(get_block(nx, ny - dy + 1, nz))) {
 	    *y = ny + pad;
 	    result = 1;
 	}
-	if(pz < -pad && is_obstacle(map_get(map, nx, ny - dy, nz - 1))) {
+	if(pz < -pad && is_obstacle(get_block(nx, ny - dy, nz - 1))) {
 	    *z = nz - pad;
 	}
-	if(pz >  pad && is_obstacle(map_get(map, nx, ny - dy, nz + 1))) {
+	if(pz >  pad && is_obstacle(get_block(nx, ny - dy, nz + 1))) {
 	    *z = nz + pad;
 	}
     }
@@ -356,7 +679,7 @@ void get_sight_vector(float rx, float ry, float *vx, float *vy, float *vz) {
     *vz = sinf(rx - RADIANS(90)) * m;
 }
 
-int _hit_test(Map *map, float max_distance, int previous, float x, float y, float z, float vx, float vy, float vz, int *hx, int *hy, int *hz) {
+int _hit_test(ChunkMap *map, float max_distance, int previous, float x, float y, float z, float vx, float vy, float vz, int *hx, int *hy, int *hz) {
     int m = 32;
     int px = 0;
     int py = 0;
@@ -366,7 +689,7 @@ int _hit_test(Map *map, float max_distance, int previous, float x, float y, floa
 	int ny = roundf(y);
 	int nz = roundf(z);
 	if(nx != px || ny != py || nz != pz) {
-	    int hw = map_get(map, nx, ny, nz);
+	    int hw = chunk_map_get(map, nx, ny, nz);
 	    if(hw > 0) {
 		if(previous) {
 		    *hx = px; *hy = py; *hz = pz;
@@ -384,287 +707,634 @@ int _hit_test(Map *map, float max_distance, int previous, float x, float y, floa
 }
 
 int hit_test(int previous, float x, float y, float z, float rx, float ry, int *bx, int *by, int *bz) {
+    PROFILE_BEGIN("hit_test");
     int result = 0;
     float best = 0;
     int p = chunked(x);
     int q = chunked(z);
     float vx, vy, vz;
     get_sight_vector(rx, ry, &vx, &vy, &vz);
-    for(int i = 0; i < g->chunk_count; i++) {
-	Chunk *chunk = g->chunks + i;
-	if(chunk_distance(chunk, p, q) > 1) {
-	    continue;
-	}
-	int hx, hy, hz;
-	int hw = _hit_test(&chunk->map, 8, previous, x, y, z, vx, vy, vz, &hx, &hy, &hz);
-	if(hw >0) {
-	    float d = sqrtf(powf(hx - x, 2) + powf(hy - y, 2) + powf(hz - z, 2));
-	    if(best == 0 || d < best) {
-		best = d;
-		*bx = hx; *by = hy; *bz = hz;
-		result = hw;
+    for(int dp = -1; dp <= 1; dp++) {
+	for(int dq = -1; dq <= 1; dq++) {
+	    Chunk *chunk = find_chunk(p + dp, q + dq);
+	    if(!chunk) {
+		continue;
+	    }
+	    int hx, hy, hz;
+	    int hw = _hit_test(&chunk->map, 8, previous, x, y, z, vx, vy, vz, &hx, &hy, &hz);
+	    if(hw >0) {
+		float d = sqrtf(powf(hx - x, 2) + powf(hy - y, 2) + powf(hz - z, 2));
+		if(best == 0 || d < best) {
+		    best = d;
+		    *bx = hx; *by = hy; *bz = hz;
+		    result = hw;
+		}
 	    }
 	}
     }
+    PROFILE_END();
     return result;
 }
 
-#define Y_SIZE 258
-#define XZ_SIZE (CHUNK_SIZE * 3 + 2)
-#define XZ_LO (CHUNK_SIZE)
-#define XZ_HI (CHUNK_SIZE * 2 + 1)
-#define XZ(x, z) ((x) * XZ_SIZE  + (z))
-#define XYZ(x, y, z) ((y) * XZ_SIZE * XZ_SIZE + (x) * XZ_SIZE + (z))
-
-float* compute_chunk(Chunk *chunk, Map *block_maps[3][3], Map *light_maps[3][3]) {
-    char *opaque  = (char*)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
-    char *light   = (char*)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
-    char *highest = (char*)calloc(XZ_SIZE * XZ_SIZE, sizeof(char));
-
-    int ox = chunk->p * CHUNK_SIZE - CHUNK_SIZE - 1;
-    int oy = -1;
-    int oz = chunk->q * CHUNK_SIZE - CHUNK_SIZE - 1;
-
-    // Populate opaque array
-    for(int a = 0; a < 3; a++) {
-    	for(int b = 0; b < 3; b++) {
-    	    Map *map = block_maps[a][b];
-    	    if(!map) {
-    		continue;
-    	    }
-    	    MAP_FOR_EACH(map, ex, ey, ez, ew) {
-    		int x = ex - ox;
-    		int y = ey - oy;
-    		int z = ez - oz;
-    		int w = ew;
-                // TODO: this should be unnecessary
-                if (x < 0 || y < 0 || z < 0) {
-                    continue;
-                }
-                if (x >= XZ_SIZE || y >= Y_SIZE || z >= XZ_SIZE) {
-                    continue;
-                }
-                // END TODO
-    		opaque[XYZ(x, y, z)] = !is_transparent(w);
-    		if(opaque[XYZ(x, y, z)]) {
-    		    highest[XZ(x, z)] = MAX(highest[XZ(x, z)], y);
-    		}
-    	    } END_MAP_FOR_EACH
-    	}
-    }
-
-    Map *map = block_maps[1][1];
-
-    // Count exposed faces
-    int maxy = 0;
-    int miny = 256;
-    int faces = 0;
-    MAP_FOR_EACH(map, ex, ey, ez, ew) {
-    	if(ew <= 0) {
-    	    continue;
-    	}
-    	int x = ex - ox;
-    	int y = ey - oy;
-    	int z = ez - oz;
-    	int f1 = !opaque[XYZ(x - 1, y, z)];
-    	int f2 = !opaque[XYZ(x + 1, y, z)];
-    	int f3 = !opaque[XYZ(x, y + 1, z)];
-    	int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0);
-    	int f5 = !opaque[XYZ(x, y, z - 1)];
-    	int f6 = !opaque[XYZ(x, y, z + 1)];
-    	int total = f1 + f2 + f3 + f4 + f5 + f6;
-    	if(total == 0) {
-    	    continue;
-    	}
-    	if(is_plant(ew)) {
-    	    total = 4;
-    	}
-    	miny = MIN(miny, ey);
-    	maxy = MAX(maxy, ey);
-    	faces += total;
-    } END_MAP_FOR_EACH;
+// Points the vertex array at the arena buffer and the quad indices
+void mesh_arena_bind() {
+    MeshArena *arena = &g->arena;
+    glBindVertexArray(arena->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, arena->buffer);
+    glEnableVertexAttribArray(BLOCK_VERTEX);
+    glVertexAttribIPointer(BLOCK_VERTEX, CUBE_VERTEX_WORDS, GL_UNSIGNED_INT, sizeof(uint32_t) * CUBE_VERTEX_WORDS, (void*)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g->quad_indices);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    // Generate geometry
-    int offset = 0;
-    GLfloat *data = (GLfloat*)malloc(sizeof(GLfloat) * 6 * 10 * faces);
-    
-    MAP_FOR_EACH(map, ex, ey, ez, ew) {
-    	if(ew <= 0) {
-    	    continue;
-    	}
-    	int x = ex - ox;
-    	int y = ey - oy;
-    	int z = ez - oz;
-    	int f1 = !opaque[XYZ(x - 1, y, z)];
-    	int f2 = !opaque[XYZ(x + 1, y, z)];
-    	int f3 = !opaque[XYZ(x, y + 1, z)];
-    	int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0);
-    	int f5 = !opaque[XYZ(x, y, z - 1)];
-    	int f6 = !opaque[XYZ(x, y, z + 1)];
-    	int total = f1 + f2 + f3 + f4 + f5 + f6;
-    	if(total == 0) {
-    	    continue;
-    	}
-	
-    	int index = 0;
-    	char neighbors[27] = { 0 };
-    	char lights[27] = { 0 };
-    	float shades[27] = { 0 };
-    	for(int dx = -1; dx <= 1; dx++) {
-    	    for(int dy = -1; dy <= 1; dy++) {
-    		for(int dz = -1; dz <= 1; dz++) {
-    		    shades[index] = 0;
-    		    lights[index] = light[XYZ(x + dx, y + dy, z + dz)];
-    		    neighbors[index] = opaque[XYZ(x + dx, y + dy, z + dz)];
-    		    if(y + dy <= highest[XZ(x + dx, z + dz)]) {
-    			for(int oy = 0; oy < 8; oy++) {
-    			    if(opaque[XYZ(x + dx, y + dy, z + dz)]) {
-    				shades[index] = 1.0 - oy * 0.125;
-    				break;
-    			    }
-    			}
-    		    }
-    		    index++;
-    		}
-    	    }
-    	}
-	
-    	float ao[6][4];
-    	float light[6][4];
-    	occlusion(neighbors, lights, shades, ao , light);
-    	if(is_plant(ew)) {
-    	    total = 4;
-    	    float min_ao = 1;
-    	    float max_light = 0;
-    	    for(int a = 0; a < 6; a++) {
-    		for(int b = 0; b < 4; b++) {
-    		    min_ao = MIN(min_ao, ao[a][b]);
-    		    max_light = MAX(max_light, light[a][b]);
-    		}
-    	    }
-    	    float rotation = simplex2(ex, ez, 4, 0.5, 2) * 360;
-    	    make_plant(data + offset, min_ao, max_light, ex, ey, ez, 0.5, ew, rotation);
-    	}
-    	else {
-    	    make_cube(data + offset, ao, light, f1, f2, f3, f4, f5, f6, ex, ey, ez, 0.5, ew);
-    	}
-    	offset += total * 60;
-    } END_MAP_FOR_EACH;
+// Grows the index buffer shared by all chunks to cover count quads
+void gen_quad_indices(int count) {
+    if(count <= g->quad_capacity) {
+	return;
+    }
+    int capacity = MAX(count, MAX(g->quad_capacity * 2, 4096));
+    uint32_t *data = (uint32_t*)malloc(sizeof(uint32_t) * 6 * capacity);
+    make_quad_indices(data, capacity);
+    glDeleteBuffers(1, &g->quad_indices);
+    glGenBuffers(1, &g->quad_indices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g->quad_indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * 6 * capacity, data, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    free(data);
+    g->quad_capacity = capacity;
+    mesh_arena_bind();
+}
+
+void mesh_arena_pages(int page, int count) {
+    MeshArena *arena = &g->arena;
+    glBindBuffer(GL_TEXTURE_BUFFER, arena->page_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, sizeof(int) * 2 * page, sizeof(int) * 2 * count,
+		    arena->pages + page * 2);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void mesh_arena_init() {
+    MeshArena *arena = &g->arena;
+    int draws = MAX_CHUNKS * (CHUNK_SECTIONS + 1);
+    arena_init(&arena->arena, ARENA_PAGES);
+    arena->pages = (int*)calloc(ARENA_PAGES * 2, sizeof(int));
+    arena->counts = (GLsizei*)malloc(sizeof(GLsizei) * draws);
+    arena->bases = (GLint*)malloc(sizeof(GLint) * draws);
+    arena->indices = (const GLvoid**)calloc(draws, sizeof(GLvoid*));
+    arena->draw_count = 0;
+    glGenVertexArrays(1, &arena->vao);
+    glGenBuffers(1, &arena->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, arena->buffer);
+    glBufferData(GL_ARRAY_BUFFER, ARENA_PAGE_BYTES * ARENA_PAGES, 0, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mesh_arena_bind();
+    glGenBuffers(1, &arena->page_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, arena->page_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(int) * 2 * ARENA_PAGES, arena->pages, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    // The page table stays bound to texture unit 1
+    glGenTextures(1, &arena->page_texture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, arena->page_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32I, arena->page_buffer);
+    glActiveTexture(GL_TEXTURE0);
+}
 
-    free(opaque);
-    free(light);
-    free(highest);
+void mesh_arena_free() {
+    MeshArena *arena = &g->arena;
+    glDeleteTextures(1, &arena->page_texture);
+    glDeleteBuffers(1, &arena->page_buffer);
+    glDeleteBuffers(1, &arena->buffer);
+    glDeleteVertexArrays(1, &arena->vao);
+    arena_free(&arena->arena);
+    free(arena->pages);
+    free(arena->counts);
+    free(arena->bases);
+    free(arena->indices);
+}
 
-    chunk->miny = miny;
-    chunk->maxy = maxy;
-    chunk->faces = faces;
-    return data;
+// Copies a section from the old buffer, bound for reading, into the new
+// one, bound for writing, along with its entries of the page table
+static void mesh_arena_move(void *owner, int from, int to, int size, void *arg) {
+    Section *section = (Section*)owner;
+    int *pages = (int*)arg;
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+			ARENA_PAGE_BYTES * from, ARENA_PAGE_BYTES * to, ARENA_PAGE_BYTES * size);
+    memcpy(pages + to * 2, g->arena.pages + from * 2, sizeof(int) * 2 * size);
+    section->page = to;
 }
 
-void gen_chunk_buffer(Chunk *chunk) {
-    Map *block_maps[3][3];
-    Map *light_maps[3][3];
+// Packs the sections into a new buffer that has room for size more pages,
+// doubling it while it would be over three quarters full
+void mesh_arena_grow(int size) {
+    MeshArena *arena = &g->arena;
+    int capacity = arena->arena.capacity;
+    while(capacity - arena->arena.used < size + capacity / 4) {
+	capacity *= 2;
+    }
+    PROFILE_BEGIN("mesh_arena_grow");
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, ARENA_PAGE_BYTES * capacity, 0, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, arena->buffer);
+    int *pages = (int*)calloc(capacity * 2, sizeof(int));
+    arena_compact(&arena->arena, capacity, mesh_arena_move, pages);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &arena->buffer);
+    arena->buffer = buffer;
+    free(arena->pages);
+    arena->pages = pages;
+    glBindBuffer(GL_TEXTURE_BUFFER, arena->page_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(int) * 2 * capacity, pages, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    mesh_arena_bind();
+    PROFILE_END();
+}
+
+void del_section_buffer(Section *section) {
+    if(section->faces) {
+	arena_release(&g->arena.arena, section->page);
+    }
+    section->faces = 0;
+    section->cutout = 0;
+    section->page = 0;
+}
+
+// Copies the mesh into pages of the arena that now belong to the section
+void gen_section_buffer(Chunk *chunk, Section *section, Mesh *mesh) {
+    del_section_buffer(section);
+    section->miny = mesh->miny;
+    section->maxy = mesh->maxy;
+    if(!mesh->faces) {
+	return;
+    }
+    PROFILE_BEGIN("gen_section_buffer");
+    MeshArena *arena = &g->arena;
+    gen_quad_indices(mesh->faces);
+    int count = (mesh->faces + ARENA_PAGE - 1) / ARENA_PAGE;
+    int page = arena_claim(&arena->arena, count, section);
+    if(page < 0) {
+	mesh_arena_grow(count);
+	page = arena_claim(&arena->arena, count, section);
+    }
+    for(int i = page; i < page + count; i++) {
+	arena->pages[i * 2] = chunk->p;
+	arena->pages[i * 2 + 1] = chunk->q;
+    }
+    mesh_arena_pages(page, count);
+    GLsizei size = sizeof(uint32_t) * MESH_FACE_WORDS * mesh->faces;
+    glBindBuffer(GL_ARRAY_BUFFER, arena->buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, ARENA_PAGE_BYTES * page, size, mesh->data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    section->faces = mesh->faces;
+    section->cutout = mesh->cutout;
+    section->page = page;
+    PROFILE_COUNT(PROFILE_UPLOADED, size);
+    PROFILE_END();
+}
+
+typedef struct {
+    Job job;
+    Chunk *chunk;
+    unsigned int serial;
+    unsigned int sections;
+    ChunkMap map;
+    Map lights;
+    SkyMap sky;
+    Mesh meshes[CHUNK_SECTIONS];
+} MeshJob;
+
+void mesh_job_run(Job *job) {
+    MeshJob *mesh_job = (MeshJob*)job;
+    mesh_chunk(mesh_context(), mesh_job->meshes, mesh_job->sections,
+	       &mesh_job->map, &mesh_job->lights, &mesh_job->sky);
+}
+
+void mesh_job_free(MeshJob *mesh_job) {
+    for(int i = 0; i < CHUNK_SECTIONS; i++) {
+	mesh_free(mesh_job->meshes + i);
+    }
+    free(mesh_job);
+}
+
+void mesh_job_done(Job *job) {
+    MeshJob *mesh_job = (MeshJob*)job;
+    Chunk *chunk = mesh_job->chunk;
+    chunk_map_free(&mesh_job->map);
+    map_free(&mesh_job->lights);
+    sky_free(&mesh_job->sky);
+    if(chunk->serial != mesh_job->serial) {
+	mesh_job_free(mesh_job);
+	return;
+    }
+    chunk->job = 0;
+    if(job->cancelled) {
+	chunk->dirty |= mesh_job->sections;
+	mesh_job_free(mesh_job);
+	return;
+    }
+    job->next = 0;
+    if(g->uploads_tail) {
+	g->uploads_tail->next = job;
+    }
+    else {
+	g->uploads = job;
+    }
+    g->uploads_tail = job;
+}
 
+void request_chunk_mesh(Chunk *chunk) {
+    ChunkMap *block_maps[3][3];
+    Map *light_maps[3][3];
+    SkyMap *sky_maps[3][3];
     for(int dp = -1; dp <= 1; dp++) {
 	for(int dq = -1; dq <= 1; dq++) {
-	    Chunk *other = chunk;
-	    if(dp || dq) {
-		other = find_chunk(chunk->p + dp, chunk->q + dq);
-	    }
-	    if(other) {
+	    Chunk *other = chunk->neighbors[dp + 1][dq + 1];
+	    if(other && other->ready) {
 		block_maps[dp + 1][dq + 1] = &other->map;
 		light_maps[dp + 1][dq + 1] = &other->lights;
+		sky_maps[dp + 1][dq + 1] = &other->sky;
 	    }
 	    else {
 		block_maps[dp + 1][dq + 1] = 0;
 		light_maps[dp + 1][dq + 1] = 0;
+		sky_maps[dp + 1][dq + 1] = 0;
 	    }
 	}
     }
-    
-    float *data = compute_chunk(chunk, block_maps, light_maps);
-
-    // GLuint vao;
-    // glGenVertexArrays(1, &vao);
-    // glBindVertexArray(vao);
-    glDeleteBuffers(1, &chunk->buffer);
-    GLuint buffer;
-    GLsizei size = sizeof(float) * 6 * 10 * chunk->faces;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    chunk->buffer = buffer;
+    MeshJob *mesh_job = (MeshJob*)calloc(1, sizeof(MeshJob));
+    mesh_job->job.func = mesh_job_run;
+    mesh_job->job.done = mesh_job_done;
+    mesh_job->chunk = chunk;
+    mesh_job->serial = chunk->serial;
+    mesh_job->sections = chunk->dirty;
+    mesh_snapshot(&mesh_job->map, block_maps);
+    mesh_snapshot_lights(&mesh_job->lights, light_maps);
+    mesh_snapshot_sky(&mesh_job->sky, sky_maps);
     chunk->dirty = 0;
+    chunk->job = &mesh_job->job;
+    worker_pool_submit(&g->workers, &mesh_job->job);
+}
+
+// Totals the faces and y-bounds of the sections and clouds that have
+// geometry
+void update_chunk_bounds(Chunk *chunk) {
+    chunk->faces = 0;
+    chunk->miny = 256;
+    chunk->maxy = 0;
+    for(int i = 0; i <= CHUNK_SECTIONS; i++) {
+	Section *section = i < CHUNK_SECTIONS ? chunk->sections + i : &chunk->clouds;
+	if(section->faces) {
+	    chunk->faces += section->faces;
+	    chunk->miny = MIN(chunk->miny, section->miny);
+	    chunk->maxy = MAX(chunk->maxy, section->maxy);
+	}
+    }
+}
+
+// Uploads finished meshes until the per frame byte budget is spent
+void upload_chunk_meshes() {
+    int bytes = 0;
+    while(g->uploads && bytes < MESH_UPLOAD_BUDGET) {
+	MeshJob *mesh_job = (MeshJob*)g->uploads;
+	g->uploads = g->uploads->next;
+	if(!g->uploads) {
+	    g->uploads_tail = 0;
+	}
+	Chunk *chunk = mesh_job->chunk;
+	for(int i = 0; i < CHUNK_SECTIONS; i++) {
+	    if(!(mesh_job->sections & (1u << i))) {
+		continue;
+	    }
+	    if(chunk->serial == mesh_job->serial) {
+		gen_section_buffer(chunk, chunk->sections + i, mesh_job->meshes + i);
+	    }
+	    bytes += sizeof(uint32_t) * MESH_FACE_WORDS * mesh_job->meshes[i].faces;
+	}
+	if(chunk->serial == mesh_job->serial) {
+	    update_chunk_bounds(chunk);
+	}
+	PROFILE_COUNT(PROFILE_MESHED, 1);
+	mesh_job_free(mesh_job);
+    }
 }
 
 void init_chunk(Chunk *chunk, int p, int q) {
     chunk->p = p;
     chunk->q = q;
     chunk->faces = 0;
-    chunk->buffer = 0;
-    Map *block_map = &chunk->map;
+    chunk->dirty = 0;
+    chunk->ready = 0;
+    chunk->job = 0;
+    memset(chunk->sections, 0, sizeof(chunk->sections));
+    memset(&chunk->clouds, 0, sizeof(chunk->clouds));
+    chunk->serial = ++g->chunk_serial;
+    ChunkMap *block_map = &chunk->map;
     Map *light_map = &chunk->lights;
     int dx = p * CHUNK_SIZE - 1;
     int dy = 0;
     int dz = q * CHUNK_SIZE - 1;
-    map_alloc(block_map, dx, dy, dz, 0x7fff);
+    chunk_map_alloc(block_map, p * CHUNK_SIZE, q * CHUNK_SIZE);
     map_alloc(light_map, dx, dy, dz, 0xf);
+    sky_alloc(&chunk->sky, p * CHUNK_SIZE, q * CHUNK_SIZE);
+}
+
+typedef struct {
+    Job job;
+    Chunk *chunk;
+    unsigned int serial;
+    int p;
+    int q;
+    ChunkMap map;
+    SkyMap sky;
+    Mesh clouds;
+} GenJob;
+
+void gen_job_run(Job *job) {
+    GenJob *gen = (GenJob*)job;
+    chunk_map_alloc(&gen->map, gen->p * CHUNK_SIZE, gen->q * CHUNK_SIZE);
+    create_world(gen->p, gen->q, &gen->map);
+    sky_alloc(&gen->sky, gen->p * CHUNK_SIZE, gen->q * CHUNK_SIZE);
+    sky_compute(&gen->sky, &gen->map);
+    if(SHOW_CLOUDS) {
+	unsigned char depth[CLOUD_SIZE * CLOUD_SIZE];
+	cloud_field(depth, gen->p, gen->q);
+	cloud_mesh(&gen->clouds, depth);
+    }
+}
+
+void gen_job_done(Job *job) {
+    GenJob *gen = (GenJob*)job;
+    Chunk *chunk = gen->chunk;
+    if(chunk->serial != gen->serial) {
+	chunk_map_free(&gen->map);
+	sky_free(&gen->sky);
+	mesh_free(&gen->clouds);
+	free(gen);
+	return;
+    }
+    chunk->job = 0;
+    if(job->cancelled) {
+	chunk_map_free(&gen->map);
+	sky_free(&gen->sky);
+    }
+    else {
+	chunk_map_free(&chunk->map);
+	chunk->map = gen->map;
+	sky_free(&chunk->sky);
+	chunk->sky = gen->sky;
+	gen_section_buffer(chunk, &chunk->clouds, &gen->clouds);
+	update_chunk_bounds(chunk);
+	chunk->ready = 1;
+	chunk->dirty = ALL_SECTIONS;
+	seed_chunk_light(chunk);
+	seed_chunk_sky(chunk);
+    }
+    mesh_free(&gen->clouds);
+    free(gen);
+}
+
+void request_chunk(Chunk *chunk) {
+    GenJob *gen = (GenJob*)calloc(1, sizeof(GenJob));
+    gen->job.func = gen_job_run;
+    gen->job.done = gen_job_done;
+    gen->chunk = chunk;
+    gen->serial = chunk->serial;
+    gen->p = chunk->p;
+    gen->q = chunk->q;
+    chunk->job = &gen->job;
+    worker_pool_submit(&g->workers, &gen->job);
+}
+
+Chunk* alloc_chunk() {
+    Chunk *chunk = 0;
+    if(g->free_count) {
+	chunk = g->free_chunks[--g->free_count];
+    }
+    else if(g->pool_count < MAX_CHUNKS) {
+	chunk = g->chunk_pool + g->pool_count++;
+    }
+    if(chunk) {
+	chunk->index = g->chunk_count;
+	g->chunks[g->chunk_count++] = chunk;
+    }
+    return chunk;
+}
+
+void delete_chunk(Chunk *chunk) {
+    if(chunk->job) {
+	worker_pool_cancel(&g->workers, chunk->job);
+    }
+    for(int dp = -1; dp <= 1; dp++) {
+	for(int dq = -1; dq <= 1; dq++) {
+	    Chunk *other = chunk->neighbors[dp + 1][dq + 1];
+	    if(other && other != chunk) {
+		other->neighbors[1 - dp][1 - dq] = 0;
+	    }
+	}
+    }
+    if(chunk->ready) {
+	clear_chunk_light(chunk);
+    }
+    chunk_index_remove(&g->chunk_index, chunk->p, chunk->q);
+    chunk_map_free(&chunk->map);
+    map_free(&chunk->lights);
+    sky_free(&chunk->sky);
+    for(int i = 0; i < CHUNK_SECTIONS; i++) {
+	del_section_buffer(chunk->sections + i);
+    }
+    del_section_buffer(&chunk->clouds);
+    // Jobs still holding this slot see the serial change and drop out
+    chunk->serial = ++g->chunk_serial;
+    chunk->job = 0;
+    memset(chunk->sections, 0, sizeof(chunk->sections));
+    memset(&chunk->clouds, 0, sizeof(chunk->clouds));
+    chunk->faces = 0;
+    Chunk *last = g->chunks[--g->chunk_count];
+    last->index = chunk->index;
+    g->chunks[chunk->index] = last;
+    g->free_chunks[g->free_count++] = chunk;
+}
+
+void delete_chunks(Player *player) {
+    State *s = &player->state;
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    for(int i = g->chunk_count - 1; i >= 0; i--) {
+	Chunk *chunk = g->chunks[i];
+	if(chunk_distance(chunk, p, q) > g->delete_radius) {
+	    delete_chunk(chunk);
+	}
+    }
 }
 
-void map_set_func(int x, int y, int z, int w, void *arg) {
-    Map *map = (Map*)arg;
-    map_set(map, x, y, z, w);
+void check_workers() {
+    Job *job;
+    while((job = worker_pool_poll(&g->workers))) {
+	job->done(job);
+    }
+}
+
+typedef struct {
+    int p;
+    int q;
+    float priority;
+} ChunkRequest;
+
+int chunk_request_cmp(const void *a, const void *b) {
+    float pa = ((const ChunkRequest*)a)->priority;
+    float pb = ((const ChunkRequest*)b)->priority;
+    return (pa > pb) - (pa < pb);
 }
 
-void create_chunk(Chunk *chunk, int p, int q) {
-    init_chunk(chunk, p, q);
-    create_world(p, q, map_set_func, &chunk->map);
+// Lower is sooner: distance in chunks, shortened for chunks in front of
+// the player and along the direction the player is moving
+float chunk_priority(int dp, int dq, float sx, float sz, float vx, float vz) {
+    float d = sqrtf(dp * dp + dq * dq);
+    if(d == 0) {
+	return 0;
+    }
+    float view = (dp * sx + dq * sz) / d;
+    float speed = sqrtf(vx * vx + vz * vz);
+    float motion = 0;
+    if(speed > 0) {
+	motion = (dp * vx + dq * vz) / (d * speed) * MIN(1, speed / 20);
+    }
+    return d * (1 - CHUNK_VIEW_WEIGHT * view - CHUNK_MOTION_WEIGHT * motion);
 }
 
 void force_chunks(Player *player) {
+    static ChunkRequest requests[MAX_CHUNKS];
     State *s = &player->state;
     int p = chunked(s->x);
     int q = chunked(s->z);
-    int r = 1;
+    int r = g->create_radius;
+    PROFILE_BEGIN("force_chunks");
+    check_workers();
+    light_update(&g->light, LIGHT_STEP_BUDGET);
+    light_update(&g->sky, LIGHT_STEP_BUDGET);
+    upload_chunk_meshes();
+    delete_chunks(player);
+
+    // Cancel work for chunks that left the radius
+    for(int i = 0; i < g->chunk_count; i++) {
+	Chunk *chunk = g->chunks[i];
+	if(chunk->job && !chunk->job->cancelled && chunk_distance(chunk, p, q) > r) {
+	    worker_pool_cancel(&g->workers, chunk->job);
+	}
+    }
+
+    float sx, sy, sz;
+    get_sight_vector(s->rx, s->ry, &sx, &sy, &sz);
+    int count = 0;
     for(int dp = -r; dp <= r; dp++) {
 	for(int dq = -r; dq <= r; dq++) {
-	    int a = p + dp;
-	    int b = q + dq;
-	    Chunk *chunk = find_chunk(a, b);
-	    if(chunk) {
-		if(chunk->dirty) {
-		    gen_chunk_buffer(chunk);
-		}
+	    Chunk *chunk = find_chunk(p + dp, q + dq);
+	    if(chunk && (chunk->job || (chunk->ready && !chunk->dirty))) {
+		continue;
 	    }
-	    else if(g->chunk_count < MAX_CHUNKS) {
-		chunk = g->chunks + g->chunk_count++;
-		create_chunk(chunk, a, b);
-		gen_chunk_buffer(chunk);
+	    ChunkRequest *request = requests + count++;
+	    request->p = p + dp;
+	    request->q = q + dq;
+	    request->priority = chunk_priority(dp, dq, sx, sz, g->vx, g->vz);
+	}
+    }
+    qsort(requests, count, sizeof(ChunkRequest), chunk_request_cmp);
+
+    int budget = CHUNK_JOB_BUDGET;
+    int pending = worker_pool_pending(&g->workers);
+    for(int i = 0; i < count && budget > 0 && pending < MAX_PENDING_JOBS; i++) {
+	ChunkRequest *request = requests + i;
+	Chunk *chunk = find_chunk(request->p, request->q);
+	if(!chunk) {
+	    chunk = alloc_chunk();
+	    if(!chunk) {
+		continue;
 	    }
+	    init_chunk(chunk, request->p, request->q);
+	    link_chunk(chunk);
+	}
+	if(chunk->ready) {
+	    request_chunk_mesh(chunk);
+	}
+	else {
+	    request_chunk(chunk);
 	}
+	budget--;
+	pending++;
+    }
+    PROFILE_END();
+}
+
+static int chunk_draw_cmp(const void *a, const void *b) {
+    float da = ((const ChunkDraw*)a)->distance;
+    float db = ((const ChunkDraw*)b)->distance;
+    return (da > db) - (da < db);
+}
+
+// view is the camera matrix without its translation, block.vs moves the
+// vertices relative to the camera itself
+void render_pass(Attrib *attrib, float *view, State *s, int count, int cutout) {
+    float bx = floorf(s->x);
+    float by = floorf(s->y);
+    float bz = floorf(s->z);
+    glUseProgram(attrib->program);
+    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, view);
+    glUniform3i(attrib->extra6, bx, by, bz);
+    glUniform3f(attrib->camera, s->x - bx, s->y - by, s->z - bz);
+    glUniform1i(attrib->sampler, 0);
+    glUniform1i(attrib->extra5, 1);
+    glUniform1f(attrib->extra3, g->render_radius * CHUNK_SIZE);
+    for(int i = 0; i < count; i++) {
+	draw_chunk(g->visible[i].chunk, cutout, roundf(s->y));
     }
+    draw_sections();
 }
 
-int render_chunks(Attrib *attrib, Player *player) {
+// Draws the opaque faces of the visible chunks front to back, so that
+// the depth test rejects hidden fragments before they are shaded, then
+// the cut-out faces with the shader that discards
+int render_chunks(Attrib *opaque, Attrib *cutout, Player *player) {
     int result = 0;
     State *s = &player->state;
     force_chunks(player);
-    // int p = chunked(s->x);
-    // int q = chunked(s->z);
-    
+    PROFILE_BEGIN("render_chunks");
+    int p = chunked(s->x);
+    int q = chunked(s->z);
     float matrix[16];
     set_matrix_3d(matrix, g->width, g->height, s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
-    glUseProgram(attrib->program);
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
-    glUniform1i(attrib->sampler, 0);
-    glUniform1f(attrib->extra3, g->render_radius * CHUNK_SIZE);
-
+    float planes[6][4];
+    frustum_planes(planes, matrix);
+    int count = 0;
     for(int i = 0; i < g->chunk_count; i++) {
-	Chunk *chunk = g->chunks + i;
-	draw_chunk(attrib, chunk);
+	Chunk *chunk = g->chunks[i];
+	if(!chunk->faces) {
+	    continue;
+	}
+	if(!chunk_visible(planes, chunk, p, q)) {
+	    PROFILE_COUNT(PROFILE_CULLED, 1);
+	    PROFILE_COUNT(PROFILE_CULLED_FACES, chunk->faces);
+	    continue;
+	}
+	float dx = chunk->p * CHUNK_SIZE + CHUNK_SIZE / 2 - s->x;
+	float dy = (chunk->miny + chunk->maxy) / 2 - s->y;
+	float dz = chunk->q * CHUNK_SIZE + CHUNK_SIZE / 2 - s->z;
+	ChunkDraw *draw = g->visible + count++;
+	draw->distance = dx * dx + dy * dy + dz * dz;
+	draw->chunk = chunk;
+	PROFILE_COUNT(PROFILE_DRAWN, 1);
+	PROFILE_COUNT(PROFILE_DRAWN_FACES, chunk->faces);
 	result += chunk->faces;
     }
+    qsort(g->visible, count, sizeof(ChunkDraw), chunk_draw_cmp);
+    float view[16];
+    set_matrix_3d(view, g->width, g->height, 0, 0, 0, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
+    render_pass(opaque, view, s, count, 0);
+    render_pass(cutout, view, s, count, 1);
+    PROFILE_END();
     return result;
 }
 
@@ -679,15 +1349,45 @@ void render_wireframe(Attrib *attrib, Player *player) {
 	glLineWidth(1);
 	glEnable(GL_COLOR_LOGIC_OP);
 	glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
-	GLuint wireframe_buffer = gen_wireframe_buffer(hx, hy, hz, 0.53);
-	draw_lines(attrib, wireframe_buffer, 3, 24);
-	glDeleteBuffers(1, &wireframe_buffer);
+	float data[72];
+	make_cube_wireframe(data, hx, hy, hz, 0.53);
+	int offset = stream_write(data, sizeof(data));
+	if(offset >= 0) {
+	    draw_lines(attrib, offset, 3, 24);
+	}
 	glDisable(GL_COLOR_LOGIC_OP);
     }
 }
 
 void on_light() {
-    
+    State *s = &g->players->state;
+    int hx, hy, hz;
+    int hw = hit_test(0, s->x, s->y, s->z, s->rx, s->ry, &hx, &hy, &hz);
+    if(hy > 0 && hy < 256 && is_destructable(hw)) {
+	if(chunk_light_get(hx, hy, hz, 0) == LIGHT_SOURCE) {
+	    light_remove(&g->light, hx, hy, hz);
+	    light_refill(&g->light, hx, hy, hz);
+	}
+	else {
+	    light_add_source(&g->light, hx, hy, hz);
+	}
+    }
+}
+
+// Writes the recent zones of every thread to a Chrome trace and prints
+// the frame stats
+void on_profile() {
+    ProfileStats stats;
+    profile_stats(&stats);
+    printf("frames %d: p50 %.2f ms, p99 %.2f ms, max %.2f ms, %d over budget, %.2f chunks meshed and %.1f KB uploaded per frame\n",
+	   stats.frames, stats.p50, stats.p99, stats.max, stats.over,
+	   stats.counters[PROFILE_MESHED], stats.counters[PROFILE_UPLOADED] / 1024);
+    printf("per frame: %.0f chunks and %.0f faces drawn, %.0f chunks and %.0f faces culled\n",
+	   stats.counters[PROFILE_DRAWN], stats.counters[PROFILE_DRAWN_FACES],
+	   stats.counters[PROFILE_CULLED], stats.counters[PROFILE_CULLED_FACES]);
+    if(profile_dump("profile.json")) {
+	printf("wrote profile.json\n");
+    }
 }
 
 void on_right_click() {
@@ -755,6 +1455,9 @@ void on_key(GLFWwindow *window, int key, int scancode, int action, int mods) {
 	if(key == CRAFT_KEY_FLY) {
 	    g->flying = !g->flying;
 	}
+	if(PROFILE && key == CRAFT_KEY_PROFILE) {
+	    on_profile();
+	}
 	// if(key == '0') {
 	//     g->item_index = '9';
 	// }
@@ -816,6 +1519,22 @@ void on_mouse_button(GLFWwindow *window, int button, int action, int mods) {
     // }
 }
 
+void block_uniforms(Attrib *attrib, GLuint program) {
+    glUseProgram(program);
+    attrib->program = program;
+    attrib->position = BLOCK_VERTEX;
+    attrib->matrix = glGetUniformLocation(program, "matrix");
+    attrib->sampler = glGetUniformLocation(program, "sampler");
+    attrib->camera = glGetUniformLocation(program, "camera_offset");
+    attrib->timer = glGetUniformLocation(program, "timer");
+    attrib->extra1 = glGetUniformLocation(program, "sky_sampler");
+    attrib->extra2 = glGetUniformLocation(program, "daylight");
+    attrib->extra3 = glGetUniformLocation(program, "fog_distance");
+    attrib->extra4 = glGetUniformLocation(program, "ortho");
+    attrib->extra5 = glGetUniformLocation(program, "pages");
+    attrib->extra6 = glGetUniformLocation(program, "camera_block");
+}
+
 int create_window() {
     if(!glfwInit())
 	return 0;
@@ -870,6 +1589,7 @@ void handle_movement(double dt) {
     static float dy = 0;
     State *s = &g->players->state;
     int sx = 0, sz = 0;
+    PROFILE_BEGIN("handle_movement");
     if(!g->typing) {
 	float m = dt * 1.0;
 	g->ortho = glfwGetKey(g->window, CRAFT_KEY_ORTHO) ? 64 : 0;
@@ -883,6 +1603,13 @@ void handle_movement(double dt) {
 	if(glfwGetKey(g->window, GLFW_KEY_UP)) s->ry += m;
 	if(glfwGetKey(g->window, GLFW_KEY_DOWN)) s->ry -= m;	
     }
+    Chunk *chunk = find_chunk(chunked(s->x), chunked(s->z));
+    if(!g->flying && (!chunk || !chunk->ready)) {
+	// Hold the player until the terrain below has been generated
+	g->vx = g->vz = 0;
+	PROFILE_END();
+	return;
+    }
     float vx, vy, vz;
     get_motion_vector(g->flying, sz, sx, s->rx, s->ry, &vx, &vy, &vz);
     if(!g->typing) {
@@ -920,12 +1647,60 @@ void handle_movement(double dt) {
 	    dy = 0;
 	}
     }
+    if(dt > 0) {
+	g->vx = vx * step / dt;
+	g->vz = vz * step / dt;
+    }
     if(s->y < 0) {
 	s->y = highest_block(s->x, s->z) + 2;
     }
+    PROFILE_END();
+}
+
+// Flies the player along the same path every run, a wave across the
+// terrain, so the frame times of a fly-through can be compared
+void fly_through(double t) {
+    State *s = &g->players->state;
+    float dx = FLY_SPEED;
+    float dz = FLY_SPEED * cosf(t * 0.05);
+    s->x = FLY_SPEED * t;
+    s->z = FLY_SPEED * 20 * sinf(t * 0.05);
+    s->y = 100;
+    s->rx = atan2f(dz, dx) + RADIANS(90);
+    s->ry = -0.3;
+    g->fov = 65;
+    g->flying = 1;
+    g->vx = dx;
+    g->vz = dz;
 }
 
-int main() {
+// Adds up the profile stats of every PROFILE_FRAMES frames of the
+// fly-through, returns 0 once it is over and prints the totals
+int fly_frame(double now) {
+    if(++g->fly_frames % PROFILE_FRAMES) {
+	return 1;
+    }
+    ProfileStats stats;
+    profile_stats(&stats);
+    g->fly_over += stats.over;
+    g->fly_p99 = MAX(g->fly_p99, stats.p99);
+    g->fly_max = MAX(g->fly_max, stats.max);
+    printf("fly-through %5d frames: p50 %.2f ms, p99 %.2f ms, max %.2f ms, %d over %.1f ms\n",
+	   g->fly_frames, stats.p50, stats.p99, stats.max, stats.over, FRAME_BUDGET);
+    if(now - g->fly_start < g->fly_seconds) {
+	return 1;
+    }
+    printf("fly-through done: %d frames in %.1f s, %d over budget (%.1f%%), worst p99 %.2f ms, max %.2f ms\n",
+	   g->fly_frames, now - g->fly_start, g->fly_over, 100.0 * g->fly_over / g->fly_frames,
+	   g->fly_p99, g->fly_max);
+    return 0;
+}
+
+// mycraft -f [seconds] flies the scripted path without vsync and quits
+int main(int argc, char **argv) {
+    if(argc > 1 && !strcmp(argv[1], "-f")) {
+	g->fly_seconds = argc > 2 ? atof(argv[2]) : FLY_SECONDS;
+    }
     srand(time(NULL));
     rand();
     
@@ -942,7 +1717,7 @@ int main() {
 	return -1;
     }
     glfwMakeContextCurrent(g->window);
-    glfwSwapInterval(VSYNC);
+    glfwSwapInterval(g->fly_seconds ? 0 : VSYNC);
     glfwSetInputMode(g->window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetKeyCallback(g->window, on_key);
     glfwSetMouseButtonCallback(g->window, on_mouse_button);
@@ -972,6 +1747,7 @@ int main() {
 
     // Load shaders
     Attrib block_attrib = { 0 };
+    Attrib opaque_attrib = { 0 };
     Attrib line_attrib  = { 0 };
 
     GLuint program;
@@ -985,22 +1761,24 @@ int main() {
 
     // program = load_program("../shaders/block_vertex.glsl", "../shaders/block_fragment.glsl");
     program = load_program("../glsl/block.vs", "../glsl/block.fs");
-    glUseProgram(program);
-    block_attrib.program = program;
-    block_attrib.position = 0;
-    block_attrib.normal = 1;
-    block_attrib.uv = 2;
-    block_attrib.matrix = glGetUniformLocation(program, "matrix");
-    block_attrib.sampler = glGetUniformLocation(program, "sampler");
-    block_attrib.camera = glGetUniformLocation(program, "camera");
-    block_attrib.timer = glGetUniformLocation(program, "timer");
-    block_attrib.extra1 = glGetUniformLocation(program, "sky_sampler");
-    block_attrib.extra2 = glGetUniformLocation(program, "daylight");
-    block_attrib.extra3 = glGetUniformLocation(program, "fog_distance");
-    block_attrib.extra4 = glGetUniformLocation(program, "ortho");
+    block_uniforms(&block_attrib, program);
+    // Same shader without the discards, for the opaque faces
+    program = load_program_defines("../glsl/block.vs", "../glsl/block.fs", "#define OPAQUE\n");
+    block_uniforms(&opaque_attrib, program);
 
     g->create_radius = CREATE_CHUNK_RADIUS;
     g->render_radius = RENDER_CHUNK_RADIUS;
+    g->delete_radius = DELETE_CHUNK_RADIUS;
+    chunk_index_alloc(&g->chunk_index, 0xfff);
+    profile_init();
+    profile_record(PROFILE);
+    mesh_arena_init();
+    stream_init();
+    mesh_thread_init();
+    region_init();
+    worker_pool_init(&g->workers, WORKER_COUNT);
+    light_init(&g->light, chunk_light_get, chunk_light_set, chunk_light_open, 0);
+    light_init(&g->sky, chunk_sky_get, chunk_sky_set, chunk_light_open, 0);
     
     // Outer loop
     int running = 1;
@@ -1012,6 +1790,7 @@ int main() {
 	force_chunks(me);
 	
 	double previous = glfwGetTime();
+	g->fly_start = previous;
 	// Main loop
 	while(1)
 	{
@@ -1034,9 +1813,13 @@ int main() {
 	    previous   = now;
 
 	    // Handle mouse input and movement
-	    handle_mouse_input();
-
-	    handle_movement(dt);
+	    if(g->fly_seconds) {
+		fly_through(now - g->fly_start);
+	    }
+	    else {
+		handle_mouse_input();
+		handle_movement(dt);
+	    }
 
 	    // Prepare to render
 	    
@@ -1044,7 +1827,7 @@ int main() {
 
 	    // Render 3-D scene
 	    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	    int face_count = render_chunks(&block_attrib, player); (void)face_count;
+	    int face_count = render_chunks(&opaque_attrib, &block_attrib, player); (void)face_count;
 
 	    if(SHOW_WIREFRAME) {
 		render_wireframe(&line_attrib, player);
@@ -1053,6 +1836,12 @@ int main() {
 
 	    glfwPollEvents();
 	    glfwSwapBuffers(g->window);
+	    stream_frame();
+	    profile_frame();
+	    if(g->fly_seconds && !fly_frame(now)) {
+		running = 0;
+		break;
+	    }
 	    if(glfwWindowShouldClose(g->window))
 	    {
 	    	running = 0;
@@ -1062,6 +1851,13 @@ int main() {
 
     }
 
+    worker_pool_free(&g->workers);
+    region_free();
+    profile_free();
+    mesh_arena_free();
+    stream_free();
+    light_free(&g->light);
+    light_free(&g->sky);
     glfwTerminate();
     return 0;
 }
@@ -30,6 +30,12 @@ void map_alloc(Map *map, int dx, int dy, int dz, int mask) {
     map->data = (MapEntry*)calloc(map->mask + 1, sizeof(MapEntry));
 }
 
+void map_free(Map *map) {
+    free(map->data);
+    map->data = 0;
+    map->size = 0;
+}
+
 int map_set(Map *map, int x, int y, int z, int w) {
     unsigned int index = hash(x, y, z) & map->mask;
     x -= map->dx;
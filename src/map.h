@@ -40,6 +40,8 @@ typedef struct {
 
 void map_alloc(Map *map, int dx, int dy, int dz, int mask);
 
+void map_free(Map *map);
+
 int map_set(Map *map, int x, int y, int z, int w);
 
 int map_get(Map *map, int x, int y, int z);
@@ -132,9 +132,7 @@ void mat_apply(float *data, float *matrix, int count, int offset, int stride) {
     }
 }
 
-void frustum_planes(float planes[6][4], int radius, float *matrix) {
-    float znear = 0.125;
-    float zfar = radius * 32 + 64;
+void frustum_planes(float planes[6][4], float *matrix) {
     float *m = matrix;
     planes[0][0] = m[3] + m[0];
     planes[0][1] = m[7] + m[4];
@@ -152,15 +150,32 @@ void frustum_planes(float planes[6][4], int radius, float *matrix) {
     planes[3][1] = m[7] - m[5];
     planes[3][2] = m[11] - m[9];
     planes[3][3] = m[15] - m[13];
-    planes[4][0] = znear * m[3] + m[2];
-    planes[4][1] = znear * m[7] + m[6];
-    planes[4][2] = znear * m[11] + m[10];
-    planes[4][3] = znear * m[15] + m[14];
-    planes[5][0] = zfar * m[3] - m[2];
-    planes[5][1] = zfar * m[7] - m[6];
-    planes[5][2] = zfar * m[11] - m[10];
-    planes[5][3] = zfar * m[15] - m[14];
+    planes[4][0] = m[3] + m[2];
+    planes[4][1] = m[7] + m[6];
+    planes[4][2] = m[11] + m[10];
+    planes[4][3] = m[15] + m[14];
+    planes[5][0] = m[3] - m[2];
+    planes[5][1] = m[7] - m[6];
+    planes[5][2] = m[11] - m[10];
+    planes[5][3] = m[15] - m[14];
+}
 
+// Whether any of the box from (x0, y0, z0) to (x1, y1, z1) may be inside
+// the first count planes. Tests the corner furthest along each normal, so
+// boxes near an edge of the frustum can pass while outside of it.
+int frustum_box(float planes[6][4], int count,
+		float x0, float y0, float z0, float x1, float y1, float z1)
+{
+    for(int i = 0; i < count; i++) {
+	float *plane = planes[i];
+	float x = plane[0] > 0 ? x1 : x0;
+	float y = plane[1] > 0 ? y1 : y0;
+	float z = plane[2] > 0 ? z1 : z0;
+	if(plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0) {
+	    return 0;
+	}
+    }
+    return 1;
 }
 
 void mat_frustum(float *matrix, float left, float right, float bottom, float top, float znear, float zfar) {
@@ -211,7 +226,7 @@ void mat_ortho(float *matrix, float left, float right, float bottom, float top,
     matrix[11] = 0.0;
     matrix[12] = -(right + left) / width;
     matrix[13] = -(top + bottom) / height;
-    matrix[14] = -(far + near) / far - near;
+    matrix[14] = -(far + near) / depth;
     matrix[15] = 1.0;
 }
 
@@ -18,7 +18,10 @@ void mat_multiply(float *matrix, float *a, float *b);
 
 void mat_apply(float *data, float *matrix, int count, int offset, int stride);
 
-void frustum_planes(float planes[6][4], int radius, float *matrix);
+void frustum_planes(float planes[6][4], float *matrix);
+
+int frustum_box(float planes[6][4], int count,
+		float x0, float y0, float z0, float x1, float y1, float z1);
 
 void mat_frustum(float *matrix, float left, float right, float bottom, float top, float znear, float zfar);
 
@@ -0,0 +1,718 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh.h"
+#include "map.h"
+#include "item.h"
+#include "cube.h"
+#include "util.h"
+#include "profile.h"
+#include "./third_party/noise.h"
+#include "./third_party/tinycthread.h"
+
+
+// Ambient occlusion and light of the four corners of one face, the cells
+// of the 3x3x3 neighborhood it reads all lie in the layer on that side
+static void face_occlusion(char neighbors[27], char lights[27], float shades[27], int face, float ao[4], float light[4]) {
+    static const int lookup3[6][4][3] = {
+        {{0, 1, 3}, {2, 1, 5}, {6, 3, 7}, {8, 5, 7}},
+        {{18, 19, 21}, {20, 19, 23}, {24, 21, 25}, {26, 23, 25}},
+        {{6, 7, 15}, {8, 7, 17}, {24, 15, 25}, {26, 17, 25}},
+        {{0, 1, 9}, {2, 1, 11}, {18, 9, 19}, {20, 11, 19}},
+        {{0, 3, 9}, {6, 3, 15}, {18, 9, 21}, {24, 15, 21}},
+        {{2, 5, 11}, {8, 5, 17}, {20, 11, 23}, {26, 17, 23}}
+    };
+   static const int lookup4[6][4][4] = {
+        {{0, 1, 3, 4}, {1, 2, 4, 5}, {3, 4, 6, 7}, {4, 5, 7, 8}},
+        {{18, 19, 21, 22}, {19, 20, 22, 23}, {21, 22, 24, 25}, {22, 23, 25, 26}},
+        {{6, 7, 15, 16}, {7, 8, 16, 17}, {15, 16, 24, 25}, {16, 17, 25, 26}},
+        {{0, 1, 9, 10}, {1, 2, 10, 11}, {9, 10, 18, 19}, {10, 11, 19, 20}},
+        {{0, 3, 9, 12}, {3, 6, 12, 15}, {9, 12, 18, 21}, {12, 15, 21, 24}},
+        {{2, 5, 11, 14}, {5, 8, 14, 17}, {11, 14, 20, 23}, {14, 17, 23, 26}}
+    };
+    static const float curve[4] = {0.0, 0.25, 0.5, 0.75};
+    int i = face;
+    for (int j = 0; j < 4; j++) {
+        int corner = neighbors[lookup3[i][j][0]];
+        int side1 = neighbors[lookup3[i][j][1]];
+        int side2 = neighbors[lookup3[i][j][2]];
+        int value = side1 && side2 ? 3 : corner + side1 + side2;
+        float shade_sum = 0;
+        float light_sum = 0;
+        int is_light = lights[13] == 15;
+        for (int k = 0; k < 4; k++) {
+            shade_sum += shades[lookup4[i][j][k]];
+            light_sum += lights[lookup4[i][j][k]];
+        }
+        if (is_light) {
+            light_sum = 15 * 4 * 10;
+        }
+        float total = curve[value] + shade_sum / 4.0;
+        ao[j] = MIN(total, 1.0);
+        light[j] = light_sum / 15.0 / 4.0;
+    }
+}
+
+void occlusion(char neighbors[27], char lights[27], float shades[27], float ao[6][4], float light[6][4]) {
+    for (int i = 0; i < 6; i++) {
+        face_occlusion(neighbors, lights, shades, i, ao[i], light[i]);
+    }
+}
+
+#define Y_SIZE 258
+#define XZ_SIZE (CHUNK_SIZE + 2)
+#define XYZ(x, y, z) ((y) * XZ_SIZE * XZ_SIZE + (x) * XZ_SIZE + (z))
+
+// Opacity and faces are kept as one 64-bit row along x per (y, z)
+#define ROW(y, z) ((y) * XZ_SIZE + (z))
+#define OPAQUE(ctx, x, y, z) (((ctx)->opaque[ROW(y, z)] >> (x)) & 1)
+
+static tss_t mesh_context_key;
+
+void mesh_context_init(MeshContext *ctx) {
+    ctx->opaque  = (uint64_t*)calloc(XZ_SIZE * Y_SIZE, sizeof(uint64_t));
+    ctx->blocks  = (uint64_t*)calloc(XZ_SIZE * Y_SIZE, sizeof(uint64_t));
+    ctx->plants  = (uint64_t*)calloc(XZ_SIZE * Y_SIZE, sizeof(uint64_t));
+    for(int i = 0; i < 6; i++) {
+	ctx->faces[i] = (uint64_t*)calloc(XZ_SIZE * Y_SIZE, sizeof(uint64_t));
+    }
+    ctx->light   = (char*)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
+    ctx->sky     = (char*)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
+    // Greedy meshing leaves the mask clear after every slice
+    ctx->mask = (GreedyFace*)calloc(CHUNK_SIZE * CHUNK_HEIGHT, sizeof(GreedyFace));
+    ctx->first = Y_SIZE;
+    ctx->rows = 0;
+    ctx->data = 0;
+    ctx->capacity = 0;
+}
+
+void mesh_context_free(MeshContext *ctx) {
+    free(ctx->opaque);
+    free(ctx->blocks);
+    free(ctx->plants);
+    for(int i = 0; i < 6; i++) {
+	free(ctx->faces[i]);
+    }
+    free(ctx->light);
+    free(ctx->sky);
+    free(ctx->mask);
+    free(ctx->data);
+    ctx->data = 0;
+    ctx->capacity = 0;
+}
+
+static void mesh_context_destroy(void *arg) {
+    MeshContext *ctx = (MeshContext*)arg;
+    mesh_context_free(ctx);
+    free(ctx);
+}
+
+void mesh_thread_init() {
+    tss_create(&mesh_context_key, mesh_context_destroy);
+}
+
+// Context of the calling thread, created on first use and freed when
+// the thread exits
+MeshContext* mesh_context() {
+    MeshContext *ctx = (MeshContext*)tss_get(mesh_context_key);
+    if(!ctx) {
+	ctx = (MeshContext*)malloc(sizeof(MeshContext));
+	mesh_context_init(ctx);
+	tss_set(mesh_context_key, ctx);
+    }
+    return ctx;
+}
+
+// Only the rows written by the previous chunk need to be zeroed
+static void mesh_context_clear(MeshContext *ctx) {
+    if(ctx->first < ctx->rows) {
+	int first = ctx->first;
+	int count = ctx->rows - first;
+	memset(ctx->opaque + ROW(first, 0), 0, count * XZ_SIZE * sizeof(uint64_t));
+	memset(ctx->blocks + ROW(first, 0), 0, count * XZ_SIZE * sizeof(uint64_t));
+	memset(ctx->plants + ROW(first, 0), 0, count * XZ_SIZE * sizeof(uint64_t));
+	memset(ctx->light + XYZ(0, first, 0), 0, count * XZ_SIZE * XZ_SIZE);
+	memset(ctx->sky + XYZ(0, first, 0), 0, count * XZ_SIZE * XZ_SIZE);
+    }
+    ctx->first = Y_SIZE;
+    ctx->rows = 0;
+}
+
+static void mesh_context_reserve(MeshContext *ctx, int faces) {
+    if(faces <= ctx->capacity) {
+	return;
+    }
+    int capacity = MAX(faces, ctx->capacity * 2);
+    free(ctx->data);
+    ctx->data = (uint32_t*)malloc(sizeof(uint32_t) * MESH_FACE_WORDS * capacity);
+    ctx->capacity = capacity;
+}
+
+// Move the staged vertices into an exactly sized mesh. Cut-out faces are
+// staged from the start of data and opaque ones from face split on.
+static void mesh_copy(Mesh *mesh, MeshContext *ctx, int cutout, int opaque, int split, int miny, int maxy) {
+    size_t size = sizeof(uint32_t) * MESH_FACE_WORDS;
+    mesh->data = (uint32_t*)malloc(size * (cutout + opaque));
+    memcpy(mesh->data, ctx->data, size * cutout);
+    memcpy(mesh->data + cutout * MESH_FACE_WORDS, ctx->data + split * MESH_FACE_WORDS, size * opaque);
+    mesh->faces = cutout + opaque;
+    mesh->cutout = cutout;
+    mesh->miny = miny;
+    mesh->maxy = maxy;
+}
+
+// Populate the opacity rows from the blocks of the chunk and the ring
+// that mesh_snapshot filled in from its neighbors. Only the rows from
+// y0 - 1 to y1 are needed to mesh blocks y0 <= y < y1.
+static void fill_volumes(MeshContext *ctx, ChunkMap *map, int y0, int y1) {
+    int oy = -1;
+    for(int lx = -1; lx <= CHUNK_SIZE; lx++) {
+	for(int lz = -1; lz <= CHUNK_SIZE; lz++) {
+	    int ring = chunk_map_ring_index(lx, lz) >= 0;
+	    if(ring && !map->ring) {
+		continue;
+	    }
+	    int top = MIN(ring ? CHUNK_HEIGHT : map->top, y1 + 1);
+	    int x = lx + 1;
+	    int z = lz + 1;
+	    uint64_t bit = (uint64_t)1 << x;
+	    for(int ey = MAX(0, y0 - 1); ey < top; ey++) {
+		int w = ring ?
+		    chunk_map_ring_get(map, lx, ey, lz) :
+		    chunk_map_local_get(map, lx, ey, lz);
+		if(!w) {
+		    continue;
+		}
+		int y = ey - oy;
+		ctx->first = MIN(ctx->first, y);
+		ctx->rows = MAX(ctx->rows, y + 1);
+		if(w > 0 && !ring) {
+		    ctx->blocks[ROW(y, z)] |= bit;
+		    if(is_plant(w)) {
+			ctx->plants[ROW(y, z)] |= bit;
+		    }
+		}
+		if(!is_transparent(w)) {
+		    ctx->opaque[ROW(y, z)] |= bit;
+		}
+	    }
+	}
+    }
+}
+
+// Light levels around the blocks y0 <= y < y1, lights holds the levels
+// of the chunk and its ring like mesh_snapshot_lights builds them
+static void fill_lights(MeshContext *ctx, ChunkMap *map, Map *lights, int y0, int y1) {
+    if(!lights) {
+	return;
+    }
+    MAP_FOR_EACH(lights, ex, ey, ez, ew) {
+	if(ew <= 0 || ey < y0 - 1 || ey > y1) {
+	    continue;
+	}
+	int x = ex - map->dx + 1;
+	int y = ey + 1;
+	int z = ez - map->dz + 1;
+	if(x < 0 || x >= XZ_SIZE || z < 0 || z >= XZ_SIZE) {
+	    continue;
+	}
+	ctx->first = MIN(ctx->first, y);
+	ctx->rows = MAX(ctx->rows, y + 1);
+	ctx->light[XYZ(x, y, z)] = ew;
+    } END_MAP_FOR_EACH;
+}
+
+// Skylight around the blocks y0 <= y < y1 from the heights and levels
+// mesh_snapshot_sky gathered, both laid out like the rows of ctx->sky
+static void fill_sky(MeshContext *ctx, SkyMap *sky, int y0, int y1) {
+    if(!sky) {
+	return;
+    }
+    int ey0 = MAX(0, y0 - 1);
+    for(int ey = ey0; ey <= y1; ey++) {
+	char *row = ctx->sky + XYZ(0, ey + 1, 0);
+	if(ey >= sky->top) {
+	    memset(row, SKY_LIGHT, SKY_COLUMNS);
+	    continue;
+	}
+	char *levels = sky->levels + ey * SKY_COLUMNS;
+	for(int i = 0; i < SKY_COLUMNS; i++) {
+	    row[i] = ey >= sky->heights[i] ? SKY_LIGHT : levels[i];
+	}
+    }
+    ctx->first = MIN(ctx->first, ey0 + 1);
+    ctx->rows = MAX(ctx->rows, y1 + 2);
+}
+
+// Exposed faces of the rows from y0 to y1. A block shows a face where
+// its neighbor is not opaque, plants show all four of theirs when any
+// side is exposed. Returns the number of faces.
+static int find_faces(MeshContext *ctx, int y0, int y1, int *miny, int *maxy) {
+    int faces = 0;
+    *maxy = 0;
+    *miny = 256;
+    for(int y = y0 + 1; y <= y1; y++) {
+	for(int z = 1; z <= CHUNK_SIZE; z++) {
+	    int row = ROW(y, z);
+	    uint64_t blocks = ctx->blocks[row];
+	    uint64_t f[6] = { 0 };
+	    if(blocks) {
+		uint64_t opaque = ctx->opaque[row];
+		f[0] = blocks & ~(opaque << 1);
+		f[1] = blocks & ~(opaque >> 1);
+		f[2] = blocks & ~ctx->opaque[ROW(y + 1, z)];
+		f[3] = y > 1 ? blocks & ~ctx->opaque[ROW(y - 1, z)] : 0;
+		f[4] = blocks & ~ctx->opaque[ROW(y, z - 1)];
+		f[5] = blocks & ~ctx->opaque[ROW(y, z + 1)];
+	    }
+	    uint64_t any = f[0] | f[1] | f[2] | f[3] | f[4] | f[5];
+	    uint64_t plants = any & ctx->plants[row];
+	    for(int i = 0; i < 6; i++) {
+		ctx->faces[i][row] = f[i] & ~plants;
+		faces += __builtin_popcountll(ctx->faces[i][row]);
+	    }
+	    ctx->plants[row] = plants;
+	    faces += 4 * __builtin_popcountll(plants);
+	    if(any) {
+		*miny = MIN(*miny, y - 1);
+		*maxy = MAX(*maxy, y - 1);
+	    }
+	}
+    }
+    return faces;
+}
+
+static void block_occlusion(MeshContext *ctx, int x, int y, int z, float ao[6][4], float light_out[6][4]) {
+    int index = 0;
+    char neighbors[27] = { 0 };
+    char lights[27] = { 0 };
+    float shades[27] = { 0 };
+    for(int dx = -1; dx <= 1; dx++) {
+	for(int dy = -1; dy <= 1; dy++) {
+	    for(int dz = -1; dz <= 1; dz++) {
+		lights[index] = ctx->light[XYZ(x + dx, y + dy, z + dz)];
+		neighbors[index] = OPAQUE(ctx, x + dx, y + dy, z + dz);
+		shades[index] = 1 - ctx->sky[XYZ(x + dx, y + dy, z + dz)] / 15.0;
+		index++;
+	    }
+	}
+    }
+    occlusion(neighbors, lights, shades, ao, light_out);
+}
+
+// Only the corners of one face, for the greedy mesher that visits the
+// faces of a block in separate passes. Reads the layer of 9 cells on the
+// side of the face and the block itself.
+static void block_face_occlusion(MeshContext *ctx, int x, int y, int z, int face, float ao[4], float light_out[4]) {
+    static const int sides[6][2] = {
+	{0, -1}, {0, 1}, {1, 1}, {1, -1}, {2, -1}, {2, 1}
+    };
+    char neighbors[27] = { 0 };
+    char lights[27] = { 0 };
+    float shades[27] = { 0 };
+    int axis = sides[face][0];
+    for(int a = -1; a <= 1; a++) {
+	for(int b = -1; b <= 1; b++) {
+	    int d[3];
+	    d[axis] = sides[face][1];
+	    d[axis ? 0 : 1] = a;
+	    d[axis == 2 ? 1 : 2] = b;
+	    int index = (d[0] + 1) * 9 + (d[1] + 1) * 3 + d[2] + 1;
+	    lights[index] = ctx->light[XYZ(x + d[0], y + d[1], z + d[2])];
+	    neighbors[index] = OPAQUE(ctx, x + d[0], y + d[1], z + d[2]);
+	    shades[index] = 1 - ctx->sky[XYZ(x + d[0], y + d[1], z + d[2])] / 15.0;
+	}
+    }
+    lights[13] = ctx->light[XYZ(x, y, z)];
+    face_occlusion(neighbors, lights, shades, face, ao, light_out);
+}
+
+static void emit_plant(uint32_t *data, float ao[6][4], float light[6][4], int ex, int ey, int ez, int ew, int dx, int dz) {
+    float min_ao = 1;
+    float max_light = 0;
+    for(int a = 0; a < 6; a++) {
+	for(int b = 0; b < 4; b++) {
+	    min_ao = MIN(min_ao, ao[a][b]);
+	    max_light = MAX(max_light, light[a][b]);
+	}
+    }
+    float rotation = simplex2(ex, ez, 4, 0.5, 2) * 360;
+    make_plant(data, min_ao, max_light, ex - dx, ey, ez - dz, ew, rotation);
+}
+
+// Emit the plants whose faces find_faces marked as exposed
+static int emit_plants(MeshContext *ctx, ChunkMap *map, int y0, int y1, uint32_t *data) {
+    int count = 0;
+    for(int y = y0 + 1; y <= y1; y++) {
+	for(int z = 1; z <= CHUNK_SIZE; z++) {
+	    uint64_t plants = ctx->plants[ROW(y, z)];
+	    while(plants) {
+		int x = __builtin_ctzll(plants);
+		plants &= plants - 1;
+		int ew = chunk_map_local_get(map, x - 1, y - 1, z - 1);
+		float ao[6][4];
+		float light_out[6][4];
+		block_occlusion(ctx, x, y, z, ao, light_out);
+		emit_plant(data + count * MESH_FACE_WORDS, ao, light_out,
+			   map->dx + x - 1, y - 1, map->dz + z - 1, ew, map->dx, map->dz);
+		count += 4;
+	    }
+	}
+    }
+    return count;
+}
+
+// Meshes the blocks y0 <= y < y1 of the chunk
+// Exposed faces of the blocks y0 <= y < y1, the first pass of meshing
+// without the lights and the geometry
+int count_faces(MeshContext *ctx, ChunkMap *map, int y0, int y1) {
+    y1 = MIN(y1, map->top);
+    mesh_context_clear(ctx);
+    fill_volumes(ctx, map, y0, y1);
+    int miny, maxy;
+    return find_faces(ctx, y0, y1, &miny, &maxy);
+}
+
+void compute_chunk(MeshContext *ctx, Mesh *mesh, ChunkMap *map, Map *lights, SkyMap *sky, int y0, int y1) {
+    PROFILE_BEGIN("compute_chunk");
+    y1 = MIN(y1, map->top);
+    mesh_context_clear(ctx);
+    fill_volumes(ctx, map, y0, y1);
+    fill_lights(ctx, map, lights, y0, y1);
+    fill_sky(ctx, sky, y0, y1);
+
+    int miny, maxy;
+    int faces = find_faces(ctx, y0, y1, &miny, &maxy);
+
+    // Generate geometry, opaque faces are staged in the second half
+    mesh_context_reserve(ctx, faces * 2);
+    uint32_t *data = ctx->data;
+    int cutout = emit_plants(ctx, map, y0, y1, data);
+    int opaque = 0;
+
+    for(int y = y0 + 1; y <= y1; y++) {
+	for(int z = 1; z <= CHUNK_SIZE; z++) {
+	    int row = ROW(y, z);
+	    uint64_t clear = ctx->blocks[row] & ~ctx->opaque[row];
+	    uint64_t f[6];
+	    for(int i = 0; i < 6; i++) {
+		f[i] = ctx->faces[i][row];
+	    }
+	    uint64_t any = f[0] | f[1] | f[2] | f[3] | f[4] | f[5];
+	    while(any) {
+		int x = __builtin_ctzll(any);
+		any &= any - 1;
+		int ew = chunk_map_local_get(map, x - 1, y - 1, z - 1);
+		int f1 = (f[0] >> x) & 1;
+		int f2 = (f[1] >> x) & 1;
+		int f3 = (f[2] >> x) & 1;
+		int f4 = (f[3] >> x) & 1;
+		int f5 = (f[4] >> x) & 1;
+		int f6 = (f[5] >> x) & 1;
+		float ao[6][4];
+		float light_out[6][4];
+		block_occlusion(ctx, x, y, z, ao, light_out);
+		int count = f1 + f2 + f3 + f4 + f5 + f6;
+		int cut = (clear >> x) & 1;
+		int index = cut ? cutout : faces + opaque;
+		make_cube(data + index * MESH_FACE_WORDS, ao, light_out, f1, f2, f3, f4, f5, f6, x - 1, y - 1, z - 1, ew);
+		if(cut) {
+		    cutout += count;
+		}
+		else {
+		    opaque += count;
+		}
+	    }
+	}
+    }
+
+    mesh_copy(mesh, ctx, cutout, opaque, faces, miny, maxy);
+    PROFILE_END();
+}
+
+// Corner bit of each face that runs along the u axis of its slice, the
+// other one runs along v
+static const int greedy_ubit[6] = {1, 1, 2, 2, 2, 2};
+
+static void greedy_shade(GreedyFace *face, int i) {
+    face->shade = 0;
+    for(int j = 0; j < 4; j++) {
+	face->shade |= cube_quantize(face->ao[j]) << (j * 8);
+	face->shade |= cube_quantize(face->light[j]) << (j * 8 + 4);
+    }
+    // Corners j and j ^ bit sit at either end of the face along an axis
+    face->flat = 0;
+    for(int k = 0; k < 2; k++) {
+	int bit = k ? 3 ^ greedy_ubit[i] : greedy_ubit[i];
+	int flat = 1;
+	for(int j = 0; j < 4; j++) {
+	    unsigned int a = (face->shade >> (j * 8)) & 0xff;
+	    unsigned int b = (face->shade >> ((j ^ bit) * 8)) & 0xff;
+	    flat = flat && a == b;
+	}
+	face->flat |= flat << k;
+    }
+}
+
+// Faces merge when their vertices would come out the same and the
+// corners don't change along the axis the quad grows in, so the merged
+// quad interpolates to the same shading
+static int greedy_match(GreedyFace *a, GreedyFace *b, int axis) {
+    return a->tile && (a->flat >> axis & 1) && b->tile == a->tile &&
+	b->cutout == a->cutout && b->shade == a->shade;
+}
+
+// Same faces as compute_chunk, but coplanar neighbors that share tile, ao
+// and light are merged into one quad. Plants are emitted as usual.
+void compute_chunk_greedy(MeshContext *ctx, Mesh *mesh, ChunkMap *map, Map *lights, SkyMap *sky, int y0, int y1) {
+    // Normal axis and the two axes (u, v) of the slice for each face
+    static const int axes[6][3] = {
+	{0, 2, 1}, {0, 2, 1}, {1, 0, 2}, {1, 0, 2}, {2, 0, 1}, {2, 0, 1}
+    };
+    PROFILE_BEGIN("compute_chunk_greedy");
+    y1 = MIN(y1, map->top);
+    mesh_context_clear(ctx);
+    GreedyFace *mask = ctx->mask;
+
+    fill_volumes(ctx, map, y0, y1);
+    fill_lights(ctx, map, lights, y0, y1);
+    fill_sky(ctx, sky, y0, y1);
+
+    // The per face count is an upper bound for the merged quads, opaque
+    // ones are staged in the second half
+    int miny, maxy;
+    int faces = find_faces(ctx, y0, y1, &miny, &maxy);
+    mesh_context_reserve(ctx, faces * 2);
+    uint32_t *data = ctx->data;
+    int cutout = emit_plants(ctx, map, y0, y1, data);
+    int opaque = 0;
+
+    int base[3] = { 0, y0, 0 };
+    int extent[3] = { CHUNK_SIZE, MAX(0, y1 - y0), CHUNK_SIZE };
+    for(int i = 0; i < 6; i++) {
+	int n = axes[i][0];
+	int u = axes[i][1];
+	int v = axes[i][2];
+	int nu = extent[u];
+	int nv = extent[v];
+	// Faces facing x take their slices across the rows, skip the ones
+	// no row has a face in
+	uint64_t any = 0;
+	for(int y = y0 + 1; n == 0 && y <= y1; y++) {
+	    for(int z = 1; z <= CHUNK_SIZE; z++) {
+		any |= ctx->faces[i][ROW(y, z)];
+	    }
+	}
+	for(int slice = 0; slice < extent[n]; slice++) {
+	    if(n == 0 && !((any >> (slice + 1)) & 1)) {
+		continue;
+	    }
+	    // Collect the exposed faces of this slice, the rest of the mask
+	    // was cleared as the faces of the previous slice were emitted
+	    int empty = 1;
+	    for(int b = 0; b < nv; b++) {
+		uint64_t bits = 0;
+		if(n == 0) {
+		    for(int a = 0; a < nu; a++) {
+			bits |= ((ctx->faces[i][ROW(y0 + b + 1, a + 1)] >> (slice + 1)) & 1) << a;
+		    }
+		}
+		else if(n == 1) {
+		    bits = ctx->faces[i][ROW(y0 + slice + 1, b + 1)] >> 1;
+		}
+		else {
+		    bits = ctx->faces[i][ROW(y0 + b + 1, slice + 1)] >> 1;
+		}
+		while(bits) {
+		    int a = __builtin_ctzll(bits);
+		    bits &= bits - 1;
+		    GreedyFace *face = mask + b * nu + a;
+		    int local[3];
+		    local[n] = base[n] + slice;
+		    local[u] = base[u] + a;
+		    local[v] = base[v] + b;
+		    int ew = chunk_map_local_get(map, local[0], local[1], local[2]);
+		    block_face_occlusion(ctx, local[0] + 1, local[1] + 1, local[2] + 1, i, face->ao, face->light);
+		    // Tile 0 is a real tile, keep 0 for "no face"
+		    face->tile = blocks[ew][i] + 1;
+		    face->cutout = is_transparent(ew);
+		    greedy_shade(face, i);
+		    empty = 0;
+		}
+	    }
+	    if(empty) {
+		continue;
+	    }
+	    // Grow rectangles along u first, then along v
+	    for(int b = 0; b < nv; b++) {
+		for(int a = 0; a < nu;) {
+		    GreedyFace *face = mask + b * nu + a;
+		    if(!face->tile) {
+			a++;
+			continue;
+		    }
+		    int w = 1;
+		    int h = 1;
+		    while(a + w < nu && greedy_match(face, mask + b * nu + a + w, 0)) {
+			w++;
+		    }
+		    int grow = 1;
+		    while(grow && b + h < nv) {
+			for(int k = 0; k < w; k++) {
+			    if(!greedy_match(face, mask + (b + h) * nu + a + k, 1)) {
+				grow = 0;
+				break;
+			    }
+			}
+			if(grow) {
+			    h++;
+			}
+		    }
+		    int local[3];
+		    int size[3];
+		    local[n] = base[n] + slice;
+		    local[u] = base[u] + a;
+		    local[v] = base[v] + b;
+		    size[n] = 1;
+		    size[u] = w;
+		    size[v] = h;
+		    int index = face->cutout ? cutout++ : faces + opaque++;
+		    make_cube_quad(data + index * MESH_FACE_WORDS, face->ao, face->light, i, face->tile - 1,
+				   local[0], local[1], local[2], size[0], size[1], size[2]);
+		    for(int l = 0; l < h; l++) {
+			for(int k = 0; k < w; k++) {
+			    mask[(b + l) * nu + a + k].tile = 0;
+			}
+		    }
+		    a += w;
+		}
+	    }
+	}
+    }
+
+    mesh_copy(mesh, ctx, cutout, opaque, faces, miny, maxy);
+    PROFILE_END();
+}
+
+void mesh_snapshot(ChunkMap *dst, ChunkMap *maps[3][3]) {
+    ChunkMap *center = maps[1][1];
+    chunk_map_copy(dst, center);
+    for(int lx = -1; lx <= CHUNK_SIZE; lx++) {
+	for(int lz = -1; lz <= CHUNK_SIZE; lz++) {
+	    if(chunk_map_ring_index(lx, lz) < 0) {
+		continue;
+	    }
+	    int a = lx < 0 ? 0 : (lx < CHUNK_SIZE ? 1 : 2);
+	    int b = lz < 0 ? 0 : (lz < CHUNK_SIZE ? 1 : 2);
+	    ChunkMap *other = maps[a][b];
+	    signed char *column = chunk_map_ring_column(dst, lx, lz);
+	    if(!other) {
+		// Generated ground of the neighbor until it is loaded
+		int index = chunk_map_ring_index(lx, lz);
+		int height = center->edge_height[index];
+		memset(column, -center->edge_block[index], height);
+		memset(column + height, 0, CHUNK_HEIGHT - height);
+		continue;
+	    }
+	    int x = center->dx + lx - other->dx;
+	    int z = center->dz + lz - other->dz;
+	    for(int y = 0; y < CHUNK_HEIGHT; y++) {
+		column[y] = y < other->top ? -chunk_map_local_get(other, x, y, z) : 0;
+	    }
+	}
+    }
+}
+
+// Copies the light levels of the center chunk and the ones of its
+// neighbors that fall in the ring into one map based like the ring
+void mesh_snapshot_lights(Map *dst, Map *maps[3][3]) {
+    Map *center = maps[1][1];
+    map_alloc(dst, center->dx, center->dy, center->dz, 0xff);
+    for(int a = 0; a < 3; a++) {
+	for(int b = 0; b < 3; b++) {
+	    Map *other = maps[a][b];
+	    if(!other) {
+		continue;
+	    }
+	    MAP_FOR_EACH(other, ex, ey, ez, ew) {
+		if(ew <= 0) {
+		    continue;
+		}
+		int x = ex - dst->dx;
+		int z = ez - dst->dz;
+		if(x < 0 || x >= XZ_SIZE || z < 0 || z >= XZ_SIZE) {
+		    continue;
+		}
+		map_set(dst, ex, ey, ez, ew);
+	    } END_MAP_FOR_EACH;
+	}
+    }
+}
+
+// Heights of the chunk and its ring and the levels below them, so the
+// mesher sees the same skylight across the seams
+void mesh_snapshot_sky(SkyMap *dst, SkyMap *maps[3][3]) {
+    SkyMap *center = maps[1][1];
+    sky_alloc(dst, center->dx, center->dz);
+    for(int lx = -1; lx <= CHUNK_SIZE; lx++) {
+	for(int lz = -1; lz <= CHUNK_SIZE; lz++) {
+	    int a = lx < 0 ? 0 : (lx < CHUNK_SIZE ? 1 : 2);
+	    int b = lz < 0 ? 0 : (lz < CHUNK_SIZE ? 1 : 2);
+	    SkyMap *other = maps[a][b];
+	    if(other) {
+		int height = sky_height(other, dst->dx + lx, dst->dz + lz);
+		dst->heights[SKY_COLUMN(lx, lz)] = height;
+		dst->top = MAX(dst->top, height);
+	    }
+	}
+    }
+    dst->levels = (char*)calloc(SKY_COLUMNS * MAX(dst->top, 1), sizeof(char));
+    for(int a = 0; a < 3; a++) {
+	for(int b = 0; b < 3; b++) {
+	    SkyMap *other = maps[a][b];
+	    if(!other) {
+		continue;
+	    }
+	    Map *map = &other->map;
+	    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+		if(ew <= 0 || ey >= dst->top) {
+		    continue;
+		}
+		int lx = ex - dst->dx;
+		int lz = ez - dst->dz;
+		if(lx < -1 || lx > CHUNK_SIZE || lz < -1 || lz > CHUNK_SIZE) {
+		    continue;
+		}
+		dst->levels[ey * SKY_COLUMNS + SKY_COLUMN(lx, lz)] = ew;
+	    } END_MAP_FOR_EACH;
+	}
+    }
+}
+
+// Meshes the sections of a snapshot flagged in sections, one bit per
+// section. Needs no GL, the meshes are uploaded by the caller.
+void mesh_chunk(MeshContext *ctx, Mesh meshes[CHUNK_SECTIONS], unsigned int sections, ChunkMap *map, Map *lights, SkyMap *sky) {
+    for(int i = 0; i < CHUNK_SECTIONS; i++) {
+	if(!(sections & (1u << i))) {
+	    continue;
+	}
+	int y0 = i * SECTION_HEIGHT;
+	int y1 = y0 + SECTION_HEIGHT;
+	if(y0 >= map->top) {
+	    continue;
+	}
+	if(GREEDY_MESHING) {
+	    compute_chunk_greedy(ctx, meshes + i, map, lights, sky, y0, y1);
+	}
+	else {
+	    compute_chunk(ctx, meshes + i, map, lights, sky, y0, y1);
+	}
+    }
+}
+
+void mesh_free(Mesh *mesh) {
+    free(mesh->data);
+    mesh->data = 0;
+    mesh->faces = 0;
+    mesh->cutout = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdint.h>
+
+#include "chunk_map.h"
+#include "map.h"
+#include "sky.h"
+#include "cube.h"
+
+#define MESH_FACE_WORDS (4 * CUBE_VERTEX_WORDS)
+
+
+// CPU side of a chunk mesh, 4 packed vertices per face in chunk local
+// coordinates. The first cutout faces have texels that the block shader
+// discards, plants, glass and leaves, the rest are opaque.
+typedef struct {
+    uint32_t *data;
+    int faces;
+    int cutout;
+    int miny;
+    int maxy;
+} Mesh;
+
+// One face in a slice of the greedy mesher. shade packs the quantized ao
+// and light of the corners the way the vertices store them, flat has bit
+// 0 set when they don't change along u and bit 1 when they don't along v.
+typedef struct {
+    int tile;
+    int cutout;
+    unsigned int shade;
+    int flat;
+    float ao[4];
+    float light[4];
+} GreedyFace;
+
+// Scratch reused by one meshing thread across chunks. opaque, blocks,
+// plants and faces hold one bit per block in rows along x, first and rows
+// bound what the last chunk dirtied and data stages the vertices.
+typedef struct {
+    uint64_t *opaque;
+    uint64_t *blocks;
+    uint64_t *plants;
+    uint64_t *faces[6];
+    char *light;
+    char *sky;
+    GreedyFace *mask;
+    int first;
+    int rows;
+    uint32_t *data;
+    int capacity;
+} MeshContext;
+
+
+void occlusion(char neighbors[27], char lights[27], float shades[27], float ao[6][4], float light[6][4]);
+
+void mesh_context_init(MeshContext *ctx);
+
+void mesh_context_free(MeshContext *ctx);
+
+void mesh_thread_init();
+
+MeshContext* mesh_context();
+
+void mesh_snapshot(ChunkMap *dst, ChunkMap *maps[3][3]);
+
+void mesh_snapshot_lights(Map *dst, Map *maps[3][3]);
+
+void mesh_snapshot_sky(SkyMap *dst, SkyMap *maps[3][3]);
+
+int count_faces(MeshContext *ctx, ChunkMap *map, int y0, int y1);
+
+void compute_chunk(MeshContext *ctx, Mesh *mesh, ChunkMap *map, Map *lights, SkyMap *sky, int y0, int y1);
+
+void compute_chunk_greedy(MeshContext *ctx, Mesh *mesh, ChunkMap *map, Map *lights, SkyMap *sky, int y0, int y1);
+
+void mesh_chunk(MeshContext *ctx, Mesh meshes[CHUNK_SECTIONS], unsigned int sections, ChunkMap *map, Map *lights, SkyMap *sky);
+
+void mesh_free(Mesh *mesh);
+
+
+#endif
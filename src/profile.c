@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+#include "./third_party/tinycthread.h"
+
+#define PROFILE_THREADS 32
+
+
+typedef struct {
+    const char *name;
+    double start;
+    double end;
+} ProfileEvent;
+
+// Zones of one thread. The last PROFILE_EVENTS closed zones are kept in
+// a ring, mtx only guards them against a dump from another thread.
+typedef struct {
+    int id;
+    mtx_t mtx;
+    ProfileEvent events[PROFILE_EVENTS];
+    unsigned int count;
+    ProfileEvent open[PROFILE_DEPTH];
+    int depth;
+} ProfileThread;
+
+typedef struct {
+    double time;
+    int counters[PROFILE_COUNTERS];
+} ProfileFrame;
+
+static struct {
+    tss_t key;
+    mtx_t mtx;
+    ProfileThread *threads[PROFILE_THREADS];
+    int thread_count;
+    double origin;
+    ProfileFrame frames[PROFILE_FRAMES];
+    unsigned int frame_count;
+    double frame_start;
+    int counters[PROFILE_COUNTERS];
+    int ready;
+} profile;
+
+int profile_recording = 0;
+
+
+// Microseconds, the unit of Chrome traces
+static double profile_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Buffer of the calling thread, registered on its first zone. Nothing is
+// recorded before profile_init or on threads past PROFILE_THREADS.
+static ProfileThread* profile_thread() {
+    if(!profile.ready) {
+	return 0;
+    }
+    ProfileThread *thread = (ProfileThread*)tss_get(profile.key);
+    if(thread) {
+	return thread;
+    }
+    mtx_lock(&profile.mtx);
+    if(profile.thread_count < PROFILE_THREADS) {
+	thread = (ProfileThread*)calloc(1, sizeof(ProfileThread));
+	thread->id = profile.thread_count;
+	mtx_init(&thread->mtx, mtx_plain);
+	profile.threads[profile.thread_count++] = thread;
+	tss_set(profile.key, thread);
+    }
+    mtx_unlock(&profile.mtx);
+    return thread;
+}
+
+void profile_init() {
+    tss_create(&profile.key, 0);
+    mtx_init(&profile.mtx, mtx_plain);
+    profile.thread_count = 0;
+    profile.origin = profile_now();
+    profile.frame_count = 0;
+    profile.frame_start = profile.origin;
+    memset(profile.counters, 0, sizeof(profile.counters));
+    profile.ready = 1;
+    // The calling thread is thread 0
+    profile_thread();
+}
+
+// Turns zone recording on or off. Set it before other threads open
+// zones, they read it without a lock.
+void profile_record(int enable) {
+    profile_recording = enable;
+}
+
+void profile_free() {
+    for(int i = 0; i < profile.thread_count; i++) {
+	mtx_destroy(&profile.threads[i]->mtx);
+	free(profile.threads[i]);
+    }
+    profile.thread_count = 0;
+    profile.ready = 0;
+    profile_recording = 0;
+    mtx_destroy(&profile.mtx);
+    tss_delete(profile.key);
+}
+
+void profile_begin(const char *name) {
+    ProfileThread *thread = profile_thread();
+    if(!thread) {
+	return;
+    }
+    if(thread->depth < PROFILE_DEPTH) {
+	ProfileEvent *event = thread->open + thread->depth;
+	event->name = name;
+	event->start = profile_now();
+    }
+    thread->depth++;
+}
+
+void profile_end() {
+    ProfileThread *thread = profile_thread();
+    if(!thread || !thread->depth) {
+	return;
+    }
+    thread->depth--;
+    if(thread->depth >= PROFILE_DEPTH) {
+	return;
+    }
+    ProfileEvent *event = thread->open + thread->depth;
+    event->end = profile_now();
+    mtx_lock(&thread->mtx);
+    thread->events[thread->count++ % PROFILE_EVENTS] = *event;
+    mtx_unlock(&thread->mtx);
+}
+
+void profile_count(int counter, int value) {
+    profile.counters[counter] += value;
+}
+
+// Closes the frame of the main thread that started at the previous call
+void profile_frame() {
+    double now = profile_now();
+    ProfileFrame *frame = profile.frames + profile.frame_count++ % PROFILE_FRAMES;
+    frame->time = (now - profile.frame_start) / 1e3;
+    memcpy(frame->counters, profile.counters, sizeof(profile.counters));
+    memset(profile.counters, 0, sizeof(profile.counters));
+    profile.frame_start = now;
+}
+
+static int profile_double_cmp(const void *a, const void *b) {
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+void profile_stats(ProfileStats *stats) {
+    double times[PROFILE_FRAMES];
+    int count = profile.frame_count < PROFILE_FRAMES ? profile.frame_count : PROFILE_FRAMES;
+    memset(stats, 0, sizeof(ProfileStats));
+    stats->frames = count;
+    if(!count) {
+	return;
+    }
+    for(int i = 0; i < count; i++) {
+	ProfileFrame *frame = profile.frames + i;
+	times[i] = frame->time;
+	stats->over += frame->time > FRAME_BUDGET;
+	for(int j = 0; j < PROFILE_COUNTERS; j++) {
+	    stats->counters[j] += (double)frame->counters[j] / count;
+	}
+    }
+    qsort(times, count, sizeof(double), profile_double_cmp);
+    stats->p50 = times[(count - 1) * 50 / 100];
+    stats->p99 = times[(count - 1) * 99 / 100];
+    stats->max = times[count - 1];
+}
+
+// Writes the recorded zones of every thread as Chrome trace JSON, the
+// format chrome://tracing and Perfetto load. Returns 0 on failure.
+int profile_dump(const char *path) {
+    FILE *file = fopen(path, "w");
+    if(!file) {
+	return 0;
+    }
+    fprintf(file, "{\"traceEvents\":[\n");
+    int first = 1;
+    mtx_lock(&profile.mtx);
+    for(int i = 0; i < profile.thread_count; i++) {
+	ProfileThread *thread = profile.threads[i];
+	fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+		"\"args\":{\"name\":\"%s %d\"}}",
+		first ? "" : ",\n", thread->id, thread->id ? "thread" : "main", thread->id);
+	first = 0;
+	mtx_lock(&thread->mtx);
+	unsigned int begin = thread->count > PROFILE_EVENTS ? thread->count - PROFILE_EVENTS : 0;
+	for(unsigned int j = begin; j < thread->count; j++) {
+	    ProfileEvent *event = thread->events + j % PROFILE_EVENTS;
+	    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+		    "\"ts\":%.3f,\"dur\":%.3f}",
+		    event->name, thread->id, event->start - profile.origin,
+		    event->end - event->start);
+	}
+	mtx_unlock(&thread->mtx);
+    }
+    mtx_unlock(&profile.mtx);
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return 1;
+}
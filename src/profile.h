@@ -0,0 +1,59 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "config.h"
+
+#define PROFILE_EVENTS 16384
+#define PROFILE_DEPTH 32
+#define PROFILE_FRAMES 256
+
+// Counters summed per frame, only touched from the main thread
+#define PROFILE_MESHED 0
+#define PROFILE_UPLOADED 1
+#define PROFILE_DRAWN 2
+#define PROFILE_DRAWN_FACES 3
+#define PROFILE_CULLED 4
+#define PROFILE_CULLED_FACES 5
+#define PROFILE_COUNTERS 6
+
+// Zones nest per thread and must be closed on the thread and in the
+// function that opened them. They are only recorded after
+// profile_record(1), until then each costs a test of profile_recording.
+#define PROFILE_BEGIN(name) (profile_recording ? profile_begin(name) : (void)0)
+#define PROFILE_END() (profile_recording ? profile_end() : (void)0)
+#define PROFILE_COUNT(counter, value) profile_count(counter, value)
+
+
+// Frame times in milliseconds and counters averaged over the last
+// PROFILE_FRAMES frames
+typedef struct {
+    int frames;
+    int over;			// Frames longer than FRAME_BUDGET
+    double p50;
+    double p99;
+    double max;
+    double counters[PROFILE_COUNTERS];
+} ProfileStats;
+
+
+extern int profile_recording;
+
+void profile_init();
+
+void profile_record(int enable);
+
+void profile_free();
+
+void profile_begin(const char *name);
+
+void profile_end();
+
+void profile_count(int counter, int value);
+
+void profile_frame();
+
+void profile_stats(ProfileStats *stats);
+
+int profile_dump(const char *path);
+
+#endif
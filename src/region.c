@@ -0,0 +1,143 @@
+#include <stdlib.h>
+
+#include "region.h"
+#include "world.h"
+#include "cloud.h"
+#include "profile.h"
+#include "./third_party/tinycthread.h"
+
+
+// Least recently used cache of regions. Acquiring a region that is not
+// cached claims the oldest slot nobody holds and fills it outside of the
+// lock, threads after the same region wait for it to be ready.
+static struct {
+    Region slots[REGION_CACHE_SIZE];
+    unsigned int clock;
+    int waiting;
+    mtx_t mtx;
+    cnd_t cnd;
+} cache;
+
+void region_init() {
+    for(int i = 0; i < REGION_CACHE_SIZE; i++) {
+	Region *region = cache.slots + i;
+	region->refs = 0;
+	region->ready = 0;
+	region->used = 0;
+	region->columns = (RegionColumn*)malloc(sizeof(RegionColumn) * REGION_SPAN * REGION_SPAN);
+    }
+    cache.clock = 0;
+    cache.waiting = 0;
+    mtx_init(&cache.mtx, mtx_plain);
+    cnd_init(&cache.cnd);
+}
+
+void region_free() {
+    for(int i = 0; i < REGION_CACHE_SIZE; i++) {
+	free(cache.slots[i].columns);
+	cache.slots[i].columns = 0;
+    }
+    mtx_destroy(&cache.mtx);
+    cnd_destroy(&cache.cnd);
+}
+
+// The bundled cnd_broadcast only signals one waiter on POSIX
+static void region_wake() {
+    for(int i = 0; i < cache.waiting; i++) {
+	cnd_signal(&cache.cnd);
+    }
+}
+
+static void region_wait() {
+    cache.waiting++;
+    cnd_wait(&cache.cnd, &cache.mtx);
+    cache.waiting--;
+}
+
+static Region* region_find(int rp, int rq) {
+    for(int i = 0; i < REGION_CACHE_SIZE; i++) {
+	Region *region = cache.slots + i;
+	if(region->used && region->rp == rp && region->rq == rq) {
+	    return region;
+	}
+    }
+    return 0;
+}
+
+static Region* region_victim() {
+    Region *result = 0;
+    for(int i = 0; i < REGION_CACHE_SIZE; i++) {
+	Region *region = cache.slots + i;
+	if(!region->refs && (!result || region->used < result->used)) {
+	    result = region;
+	}
+    }
+    return result;
+}
+
+static void region_fill(Region *region) {
+    PROFILE_BEGIN("region_fill");
+    world_region(region);
+    if(SHOW_CLOUDS) {
+	cloud_region(region);
+    }
+    PROFILE_END();
+}
+
+Region* region_acquire(int rp, int rq) {
+    mtx_lock(&cache.mtx);
+    Region *region;
+    while(1) {
+	region = region_find(rp, rq);
+	if(region) {
+	    region->refs++;
+	    region->used = ++cache.clock;
+	    while(!region->ready) {
+		region_wait();
+	    }
+	    break;
+	}
+	region = region_victim();
+	if(region) {
+	    region->rp = rp;
+	    region->rq = rq;
+	    region->refs = 1;
+	    region->ready = 0;
+	    region->used = ++cache.clock;
+	    mtx_unlock(&cache.mtx);
+	    region_fill(region);
+	    mtx_lock(&cache.mtx);
+	    region->ready = 1;
+	    region_wake();
+	    break;
+	}
+	// Every slot is held, wait for a release
+	region_wait();
+    }
+    mtx_unlock(&cache.mtx);
+    return region;
+}
+
+void region_release(Region *region) {
+    mtx_lock(&cache.mtx);
+    if(!--region->refs) {
+	region_wake();
+    }
+    mtx_unlock(&cache.mtx);
+}
+
+static int region_floor(int p) {
+    return p >= 0 ? p / REGION_CHUNKS : -((-p - 1) / REGION_CHUNKS) - 1;
+}
+
+// The region holding chunk (p, q)
+Region* region_acquire_chunk(int p, int q) {
+    return region_acquire(region_floor(p), region_floor(q));
+}
+
+// Columns from one before to one after the region along each axis
+RegionColumn* region_column(Region *region, int x, int z) {
+    int lx = x - region->rp * REGION_SIZE + 1;
+    int lz = z - region->rq * REGION_SIZE + 1;
+    return region->columns + lx * REGION_SPAN + lz;
+}
@@ -0,0 +1,46 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "config.h"
+
+#define REGION_CHUNKS 4
+#define REGION_SIZE (REGION_CHUNKS * CHUNK_SIZE)
+#define REGION_SPAN (REGION_SIZE + 2)
+#define REGION_CACHE_SIZE 128
+
+
+// What world generation needs to know about one column, worked out from
+// the noise once for every chunk that touches it
+typedef struct {
+    unsigned char height;	// Ground blocks below this y
+    unsigned char plant;	// Grass or flower block on the ground, or 0
+    unsigned char tree;		// Non zero where a tree stands
+    unsigned char cloud;	// Thickness of the cloud over the column
+} RegionColumn;
+
+// The columns of REGION_CHUNKS * REGION_CHUNKS chunks and the ring around
+// them, so that each chunk finds its own ring in the region too. Regions
+// are shared by the worker threads, columns are read only once acquired.
+typedef struct {
+    int rp;
+    int rq;
+    int refs;
+    int ready;
+    unsigned int used;
+    RegionColumn *columns;
+} Region;
+
+
+void region_init();
+
+void region_free();
+
+Region* region_acquire(int rp, int rq);
+
+Region* region_acquire_chunk(int p, int q);
+
+void region_release(Region *region);
+
+RegionColumn* region_column(Region *region, int x, int z);
+
+#endif
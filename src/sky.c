@@ -0,0 +1,137 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "sky.h"
+#include "light.h"
+#include "item.h"
+#include "profile.h"
+
+
+void sky_alloc(SkyMap *sky, int dx, int dz) {
+    sky->dx = dx;
+    sky->dz = dz;
+    sky->heights = (short*)calloc(SKY_COLUMNS, sizeof(short));
+    map_alloc(&sky->map, dx - 1, 0, dz - 1, 0xff);
+    sky->top = 0;
+    sky->levels = 0;
+}
+
+void sky_free(SkyMap *sky) {
+    free(sky->heights);
+    sky->heights = 0;
+    map_free(&sky->map);
+    free(sky->levels);
+    sky->levels = 0;
+    sky->top = 0;
+}
+
+// Lowest y that sees the sky in the column (x, z)
+int sky_height(SkyMap *sky, int x, int z) {
+    return sky->heights[SKY_COLUMN(x - sky->dx, z - sky->dz)];
+}
+
+int sky_get(SkyMap *sky, int x, int y, int z) {
+    if(y >= sky_height(sky, x, z)) {
+	return SKY_LIGHT;
+    }
+    return map_get(&sky->map, x, y, z);
+}
+
+// Blocks that see the sky keep their level, returns non zero when the
+// level of (x, y, z) changed
+int sky_set(SkyMap *sky, int x, int y, int z, int w) {
+    if(y >= sky_height(sky, x, z)) {
+	return 0;
+    }
+    return map_set(&sky->map, x, y, z, w);
+}
+
+// Moves the height of the column (x, z) to right above its highest
+// opaque block and returns it. Levels the blocks it uncovered kept in
+// map are dropped, they see the sky now.
+int sky_update_height(SkyMap *sky, ChunkMap *map, int x, int z) {
+    int lx = x - sky->dx;
+    int lz = z - sky->dz;
+    int height = 0;
+    for(int y = map->top - 1; y >= 0; y--) {
+	if(!is_transparent(chunk_map_local_get(map, lx, y, lz))) {
+	    height = y + 1;
+	    break;
+	}
+    }
+    short *column = sky->heights + SKY_COLUMN(lx, lz);
+    for(int y = height; y < *column; y++) {
+	map_set(&sky->map, x, y, z, 0);
+    }
+    *column = height;
+    return height;
+}
+
+typedef struct {
+    SkyMap *sky;
+    ChunkMap *map;
+} SkyContext;
+
+static int sky_inside(SkyMap *sky, int x, int z) {
+    int lx = x - sky->dx;
+    int lz = z - sky->dz;
+    return lx >= 0 && lx < CHUNK_SIZE && lz >= 0 && lz < CHUNK_SIZE;
+}
+
+static int sky_compute_get(int x, int y, int z, void *arg) {
+    SkyContext *context = (SkyContext*)arg;
+    if(!sky_inside(context->sky, x, z)) {
+	return 0;
+    }
+    return sky_get(context->sky, x, y, z);
+}
+
+static void sky_compute_set(int x, int y, int z, int w, void *arg) {
+    SkyContext *context = (SkyContext*)arg;
+    sky_set(context->sky, x, y, z, w);
+}
+
+static int sky_compute_open(int x, int y, int z, void *arg) {
+    SkyContext *context = (SkyContext*)arg;
+    if(!sky_inside(context->sky, x, z)) {
+	return 0;
+    }
+    return is_transparent(chunk_map_get(context->map, x, y, z));
+}
+
+// Skylight of a freshly generated chunk. The light falls straight down
+// each column and spreads sideways from the open blocks next to a higher
+// column, the seams with the neighbors are left to their own queues.
+void sky_compute(SkyMap *sky, ChunkMap *map) {
+    static const int offsets[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    PROFILE_BEGIN("sky_compute");
+    for(int lx = 0; lx < CHUNK_SIZE; lx++) {
+	for(int lz = 0; lz < CHUNK_SIZE; lz++) {
+	    sky_update_height(sky, map, sky->dx + lx, sky->dz + lz);
+	}
+    }
+    SkyContext context = {sky, map};
+    LightEngine engine;
+    light_init(&engine, sky_compute_get, sky_compute_set, sky_compute_open, &context);
+    for(int lx = 0; lx < CHUNK_SIZE; lx++) {
+	for(int lz = 0; lz < CHUNK_SIZE; lz++) {
+	    int x = sky->dx + lx;
+	    int z = sky->dz + lz;
+	    int height = sky->heights[SKY_COLUMN(lx, lz)];
+	    for(int i = 0; i < 4; i++) {
+		int nx = x + offsets[i][0];
+		int nz = z + offsets[i][1];
+		if(!sky_inside(sky, nx, nz)) {
+		    continue;
+		}
+		int top = sky_height(sky, nx, nz);
+		for(int y = height; y < top; y++) {
+		    light_seed(&engine, x, y, z);
+		}
+	    }
+	}
+    }
+    light_update(&engine, INT_MAX);
+    light_free(&engine);
+    PROFILE_END();
+}
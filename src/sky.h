@@ -0,0 +1,42 @@
+#ifndef SKY_H
+#define SKY_H
+
+#include "chunk_map.h"
+#include "map.h"
+
+#define SKY_LIGHT 15
+#define SKY_COLUMNS ((CHUNK_SIZE + 2) * (CHUNK_SIZE + 2))
+#define SKY_COLUMN(lx, lz) (((lx) + 1) * (CHUNK_SIZE + 2) + (lz) + 1)
+
+
+// Skylight of one chunk. Blocks at or above the height of their column
+// see the sky and have SKY_LIGHT, map keeps the levels of the blocks
+// below it that the light reaches from the side. Like the ChunkMap ring,
+// the heights around the chunk are only filled in by mesh snapshots, which
+// also copy the levels below the highest column into the dense levels.
+typedef struct {
+    int dx;
+    int dz;
+    short *heights;
+    Map map;
+    int top;
+    char *levels;
+} SkyMap;
+
+
+void sky_alloc(SkyMap *sky, int dx, int dz);
+
+void sky_free(SkyMap *sky);
+
+int sky_height(SkyMap *sky, int x, int z);
+
+int sky_get(SkyMap *sky, int x, int y, int z);
+
+int sky_set(SkyMap *sky, int x, int y, int z, int w);
+
+int sky_update_height(SkyMap *sky, ChunkMap *map, int x, int z);
+
+void sky_compute(SkyMap *sky, ChunkMap *map);
+
+
+#endif
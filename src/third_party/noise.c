@@ -42,7 +42,8 @@ const static float GRAD3[16][3] = {
     { 1, 0,-1}, {-1, 0,-1}, { 0,-1, 1}, { 0, 1, 1}
 };
 
-static unsigned char PERM[] = {
+// Padded so that 32-bit gathers of the last entries stay in bounds
+static unsigned char PERM[512 + 3] = {
     151, 160, 137,  91,  90,  15, 131,  13,
     201,  95,  96,  53, 194, 233,   7, 225,
     140,  36, 103,  30,  69, 142,   8,  99,
@@ -270,3 +271,113 @@ float simplex3(
     }
     return (1 + total / max) / 2;
 }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+// The grids evaluate several samples at once with the same float
+// operations, in the same order, as noise2 and noise3 so they agree with
+// the scalar path. noise_lanes.h is instantiated once for SSE2 and once
+// for AVX2, which is picked at run time.
+
+#define NOISE_LANES 4
+#define NOISE_TARGET
+#define NOISE_NAME(name) name##_sse2
+#include "noise_lanes.h"
+#undef NOISE_LANES
+#undef NOISE_TARGET
+#undef NOISE_NAME
+
+#define NOISE_LANES 8
+#define NOISE_GATHER 1
+#define NOISE_TARGET __attribute__((target("avx2")))
+#define NOISE_NAME(name) name##_avx2
+#include "noise_lanes.h"
+#undef NOISE_LANES
+#undef NOISE_GATHER
+#undef NOISE_TARGET
+#undef NOISE_NAME
+
+static int noise_allow_avx2 = 1;
+
+void simplex_grid_avx2(int enable) {
+    noise_allow_avx2 = enable;
+}
+
+// The CPU model is filled in by a libgcc constructor, reading it is a
+// plain load and safe from every worker thread
+static int noise_avx2(void) {
+    return noise_allow_avx2 && __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+
+void simplex2_grid(
+    float *out, const float *xs, int nx, const float *ys, int ny,
+    int octaves, float persistence, float lacunarity)
+{
+    int avx2 = noise_avx2();
+    for (int i = 0; i < nx; i++) {
+        if (avx2) {
+            simplex2_lanes_avx2(out + i * ny, xs[i], ys, ny,
+                octaves, persistence, lacunarity);
+        } else {
+            simplex2_lanes_sse2(out + i * ny, xs[i], ys, ny,
+                octaves, persistence, lacunarity);
+        }
+    }
+}
+
+void simplex3_grid(
+    float *out, const float *xs, int nx, const float *ys, int ny,
+    const float *zs, int nz,
+    int octaves, float persistence, float lacunarity)
+{
+    int avx2 = noise_avx2();
+    for (int i = 0; i < nx; i++) {
+        for (int j = 0; j < ny; j++) {
+            float *row = out + (i * ny + j) * nz;
+            if (avx2) {
+                simplex3_lanes_avx2(row, xs[i], ys[j], zs, nz,
+                    octaves, persistence, lacunarity);
+            } else {
+                simplex3_lanes_sse2(row, xs[i], ys[j], zs, nz,
+                    octaves, persistence, lacunarity);
+            }
+        }
+    }
+}
+
+#else
+
+void simplex_grid_avx2(int enable) {
+    (void)enable;
+}
+
+void simplex2_grid(
+    float *out, const float *xs, int nx, const float *ys, int ny,
+    int octaves, float persistence, float lacunarity)
+{
+    for (int i = 0; i < nx; i++) {
+        for (int j = 0; j < ny; j++) {
+            out[i * ny + j] = simplex2(
+                xs[i], ys[j], octaves, persistence, lacunarity);
+        }
+    }
+}
+
+void simplex3_grid(
+    float *out, const float *xs, int nx, const float *ys, int ny,
+    const float *zs, int nz,
+    int octaves, float persistence, float lacunarity)
+{
+    for (int i = 0; i < nx; i++) {
+        for (int j = 0; j < ny; j++) {
+            for (int k = 0; k < nz; k++) {
+                out[(i * ny + j) * nz + k] = simplex3(
+                    xs[i], ys[j], zs[k], octaves, persistence, lacunarity);
+            }
+        }
+    }
+}
+
+#endif
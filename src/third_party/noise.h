@@ -37,4 +37,20 @@ float simplex3(
     float x, float y, float z,
     int octaves, float persistence, float lacunarity);
 
+// Batch forms of simplex2 and simplex3 over the grid spanned by the
+// coordinate lists, out[i * ny + j] = simplex2(xs[i], ys[j], ...) and
+// out[(i * ny + j) * nz + k] = simplex3(xs[i], ys[j], zs[k], ...)
+void simplex2_grid(
+    float *out, const float *xs, int nx, const float *ys, int ny,
+    int octaves, float persistence, float lacunarity);
+
+void simplex3_grid(
+    float *out, const float *xs, int nx, const float *ys, int ny,
+    const float *zs, int nz,
+    int octaves, float persistence, float lacunarity);
+
+// The grids use AVX2 where the CPU has it, turning it off runs the SSE2
+// path instead. Set it before any thread generates noise.
+void simplex_grid_avx2(int enable);
+
 #endif
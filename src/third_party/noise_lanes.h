@@ -0,0 +1,212 @@
+/*
+Vector bodies of simplex2_grid and simplex3_grid, included by noise.c
+once per instruction set with these defined:
+
+NOISE_LANES   samples per vector
+NOISE_TARGET  target attribute of the functions
+NOISE_NAME    suffixes the names of this instance
+NOISE_GATHER  set to look up the permutation with AVX2 gathers
+*/
+
+#define vfloat NOISE_NAME(vfloat)
+#define vint NOISE_NAME(vint)
+#define NOISE_INLINE static inline __attribute__((always_inline)) NOISE_TARGET
+
+typedef float vfloat __attribute__((vector_size(NOISE_LANES * 4)));
+typedef int vint __attribute__((vector_size(NOISE_LANES * 4)));
+
+NOISE_INLINE vfloat NOISE_NAME(vfloat_of)(vint a) {
+    return __builtin_convertvector(a, vfloat);
+}
+
+NOISE_INLINE vfloat NOISE_NAME(vfloor)(vfloat x) {
+    vfloat t = NOISE_NAME(vfloat_of)(__builtin_convertvector(x, vint));
+    // Comparisons yield -1 in the lanes where they hold
+    return t + NOISE_NAME(vfloat_of)(t > x);
+}
+
+NOISE_INLINE vfloat NOISE_NAME(vmask)(vfloat x, vint mask) {
+    return (vfloat)((vint)x & mask);
+}
+
+NOISE_INLINE vint NOISE_NAME(perm)(vint index) {
+#ifdef NOISE_GATHER
+    __m256i bytes = _mm256_i32gather_epi32((const int *)PERM, (__m256i)index, 1);
+    return (vint)bytes & 255;
+#else
+    vint result;
+    for (int l = 0; l < NOISE_LANES; l++) {
+        result[l] = PERM[index[l]];
+    }
+    return result;
+#endif
+}
+
+// Index into GRAD3, the same as PERM[index] % 12
+NOISE_INLINE vint NOISE_NAME(grad_index)(vint index) {
+    vint p = NOISE_NAME(perm)(index);
+    return p - ((p * 171) >> 11) * 12;
+}
+
+NOISE_INLINE vfloat NOISE_NAME(grad)(vint g, int c) {
+#ifdef NOISE_GATHER
+    return (vfloat)_mm256_i32gather_ps(&GRAD3[0][0], (__m256i)(g * 3 + c), 4);
+#else
+    vfloat result;
+    for (int l = 0; l < NOISE_LANES; l++) {
+        result[l] = GRAD3[g[l]][c];
+    }
+    return result;
+#endif
+}
+
+NOISE_INLINE vfloat NOISE_NAME(noise2)(vfloat x, vfloat y) {
+    vfloat s = (x + y) * F2;
+    vfloat i = NOISE_NAME(vfloor)(x + s);
+    vfloat j = NOISE_NAME(vfloor)(y + s);
+    vfloat t = (i + j) * G2;
+
+    vfloat xx[3], yy[3];
+    xx[0] = x - (i - t);
+    yy[0] = y - (j - t);
+
+    vint i1 = -(xx[0] > yy[0]);
+    vint j1 = -(xx[0] <= yy[0]);
+
+    xx[2] = xx[0] + G2 * 2.0f - 1.0f;
+    yy[2] = yy[0] + G2 * 2.0f - 1.0f;
+    xx[1] = xx[0] - NOISE_NAME(vfloat_of)(i1) + G2;
+    yy[1] = yy[0] - NOISE_NAME(vfloat_of)(j1) + G2;
+
+    vint I = __builtin_convertvector(i, vint) & 255;
+    vint J = __builtin_convertvector(j, vint) & 255;
+    vint g[3];
+    g[0] = NOISE_NAME(grad_index)(I + NOISE_NAME(perm)(J));
+    g[1] = NOISE_NAME(grad_index)(I + i1 + NOISE_NAME(perm)(J + j1));
+    g[2] = NOISE_NAME(grad_index)(I + 1 + NOISE_NAME(perm)(J + 1));
+
+    vfloat total = {0};
+    for (int c = 0; c <= 2; c++) {
+        vfloat f = 0.5f - xx[c]*xx[c] - yy[c]*yy[c];
+        vfloat n = f * f * f * f *
+            (NOISE_NAME(grad)(g[c], 0) * xx[c] + NOISE_NAME(grad)(g[c], 1) * yy[c]);
+        n = NOISE_NAME(vmask)(n, f > 0);
+        total = c ? total + n : n;
+    }
+    return total * 70.0f;
+}
+
+NOISE_INLINE vfloat NOISE_NAME(noise3)(vfloat x, vfloat y, vfloat z) {
+    vfloat s = (x + y + z) * F3;
+    vfloat i = NOISE_NAME(vfloor)(x + s);
+    vfloat j = NOISE_NAME(vfloor)(y + s);
+    vfloat k = NOISE_NAME(vfloor)(z + s);
+    vfloat t = (i + j + k) * G3;
+
+    vfloat pos[4][3];
+    pos[0][0] = x - (i - t);
+    pos[0][1] = y - (j - t);
+    pos[0][2] = z - (k - t);
+
+    // Branch free form of the corner ordering in noise3
+    vint xy = pos[0][0] >= pos[0][1];
+    vint yz = pos[0][1] >= pos[0][2];
+    vint xz = pos[0][0] >= pos[0][2];
+    vint o1[3], o2[3];
+    o1[0] = -(xy & xz);
+    o1[1] = -(~xy & yz);
+    o1[2] = -(~xz & ~yz);
+    o2[0] = -(xy | xz);
+    o2[1] = -(~xy | yz);
+    o2[2] = -(~(yz & xz));
+
+    for (int c = 0; c <= 2; c++) {
+        pos[3][c] = pos[0][c] - 1.0f + 3.0f * G3;
+        pos[2][c] = pos[0][c] - NOISE_NAME(vfloat_of)(o2[c]) + 2.0f * G3;
+        pos[1][c] = pos[0][c] - NOISE_NAME(vfloat_of)(o1[c]) + G3;
+    }
+
+    vint I = __builtin_convertvector(i, vint) & 255;
+    vint J = __builtin_convertvector(j, vint) & 255;
+    vint K = __builtin_convertvector(k, vint) & 255;
+    vint g[4];
+    g[0] = NOISE_NAME(grad_index)(I + NOISE_NAME(perm)(J + NOISE_NAME(perm)(K)));
+    g[1] = NOISE_NAME(grad_index)(I + o1[0] +
+        NOISE_NAME(perm)(J + o1[1] + NOISE_NAME(perm)(o1[2] + K)));
+    g[2] = NOISE_NAME(grad_index)(I + o2[0] +
+        NOISE_NAME(perm)(J + o2[1] + NOISE_NAME(perm)(o2[2] + K)));
+    g[3] = NOISE_NAME(grad_index)(I + 1 +
+        NOISE_NAME(perm)(J + 1 + NOISE_NAME(perm)(K + 1)));
+
+    vfloat total = {0};
+    for (int c = 0; c <= 3; c++) {
+        vfloat grad[3];
+        grad[0] = NOISE_NAME(grad)(g[c], 0);
+        grad[1] = NOISE_NAME(grad)(g[c], 1);
+        grad[2] = NOISE_NAME(grad)(g[c], 2);
+        vfloat f = 0.6f - pos[c][0] * pos[c][0] - pos[c][1] * pos[c][1] -
+            pos[c][2] * pos[c][2];
+        vfloat n = NOISE_NAME(vmask)(f * f * f * f * DOT3(pos[c], grad), f > 0);
+        total = c ? total + n : n;
+    }
+    return total * 32.0f;
+}
+
+NOISE_TARGET static void NOISE_NAME(simplex2_lanes)(
+    float *out, float x, const float *ys, int n,
+    int octaves, float persistence, float lacunarity)
+{
+    for (int a = 0; a < n; a += NOISE_LANES) {
+        vfloat vx, vy;
+        for (int l = 0; l < NOISE_LANES; l++) {
+            vx[l] = x;
+            vy[l] = ys[a + l < n ? a + l : n - 1];
+        }
+        float freq = 1.0f;
+        float amp = 1.0f;
+        float max = 1.0f;
+        vfloat total = NOISE_NAME(noise2)(vx, vy);
+        for (int i = 1; i < octaves; i++) {
+            freq *= lacunarity;
+            amp *= persistence;
+            max += amp;
+            total += NOISE_NAME(noise2)(vx * freq, vy * freq) * amp;
+        }
+        total = (1 + total / max) / 2;
+        for (int l = 0; l < NOISE_LANES && a + l < n; l++) {
+            out[a + l] = total[l];
+        }
+    }
+}
+
+NOISE_TARGET static void NOISE_NAME(simplex3_lanes)(
+    float *out, float x, float y, const float *zs, int n,
+    int octaves, float persistence, float lacunarity)
+{
+    for (int a = 0; a < n; a += NOISE_LANES) {
+        vfloat vx, vy, vz;
+        for (int l = 0; l < NOISE_LANES; l++) {
+            vx[l] = x;
+            vy[l] = y;
+            vz[l] = zs[a + l < n ? a + l : n - 1];
+        }
+        float freq = 1.0f;
+        float amp = 1.0f;
+        float max = 1.0f;
+        vfloat total = NOISE_NAME(noise3)(vx, vy, vz);
+        for (int i = 1; i < octaves; ++i) {
+            freq *= lacunarity;
+            amp *= persistence;
+            max += amp;
+            total += NOISE_NAME(noise3)(vx * freq, vy * freq, vz * freq) * amp;
+        }
+        total = (1 + total / max) / 2;
+        for (int l = 0; l < NOISE_LANES && a + l < n; l++) {
+            out[a + l] = total[l];
+        }
+    }
+}
+
+#undef vfloat
+#undef vint
+#undef NOISE_INLINE
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include "util.h"
 #include "./third_party/lodepng.h"
@@ -70,6 +71,22 @@ GLuint load_shader(GLenum type, const char *path) {
     return shader;
 }
 
+// Compiles the shader with defines inserted after its #version line
+GLuint load_shader_defines(GLenum type, const char *path, const char *defines) {
+    char *data = load_file(path);
+    char *body = strchr(data, '\n');
+    body = body ? body + 1 : data + strlen(data);
+    size_t version = body - data;
+    char *code = (char*)malloc(version + strlen(defines) + strlen(body) + 1);
+    memcpy(code, data, version);
+    strcpy(code + version, defines);
+    strcat(code, body);
+    GLuint shader = make_shader(type, code);
+    free(code);
+    free(data);
+    return shader;
+}
+
 GLuint make_program(GLuint vs, GLuint fs) {
     GLuint program = glCreateProgram();
     glAttachShader(program, vs);
@@ -99,6 +116,13 @@ GLuint load_program(const char *vs_path, const char *fs_path) {
     return program;
 }
 
+GLuint load_program_defines(const char *vs_path, const char *fs_path, const char *defines) {
+    GLuint vs_shader = load_shader_defines(GL_VERTEX_SHADER, vs_path, defines);
+    GLuint fs_shader = load_shader_defines(GL_FRAGMENT_SHADER, fs_path, defines);
+    GLuint program   = make_program(vs_shader, fs_shader);
+    return program;
+}
+
 GLuint gen_buffer(GLsizei size, GLfloat *data) {
     GLuint buffer;
     glGenBuffers(1, &buffer);
@@ -22,10 +22,14 @@ GLuint make_shader(GLenum type, const char *code);
 
 GLuint load_shader(GLenum type, const char *path);
 
+GLuint load_shader_defines(GLenum type, const char *path, const char *defines);
+
 GLuint make_program(GLuint vs, GLuint fs);
 
 GLuint load_program(const char *vs_path, const char *fs_path);
 
+GLuint load_program_defines(const char *vs_path, const char *fs_path, const char *defines);
+
 GLuint gen_buffer(GLsizei size, GLfloat *data);
 
 void del_buffer(GLuint buffer);
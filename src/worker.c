@@ -0,0 +1,113 @@
+#include <stdlib.h>
+
+#include "worker.h"
+#include "util.h"
+
+
+static void job_push(Job **head, Job **tail, Job *job) {
+    job->next = 0;
+    if(*tail) {
+	(*tail)->next = job;
+    }
+    else {
+	*head = job;
+    }
+    *tail = job;
+}
+
+static Job* job_pop(Job **head, Job **tail) {
+    Job *job = *head;
+    if(job) {
+	*head = job->next;
+	if(!*head) {
+	    *tail = 0;
+	}
+	job->next = 0;
+    }
+    return job;
+}
+
+static int worker_run(void *arg) {
+    WorkerPool *pool = (WorkerPool*)arg;
+    mtx_lock(&pool->mtx);
+    while(1) {
+	while(!pool->stop && !pool->todo) {
+	    cnd_wait(&pool->cnd, &pool->mtx);
+	}
+	if(pool->stop) {
+	    // The bundled cnd_broadcast only signals one waiter on POSIX,
+	    // so every exiting worker wakes up the next one
+	    cnd_signal(&pool->cnd);
+	    break;
+	}
+	Job *job = job_pop(&pool->todo, &pool->todo_tail);
+	int cancelled = job->cancelled;
+	mtx_unlock(&pool->mtx);
+	if(!cancelled) {
+	    job->func(job);
+	}
+	mtx_lock(&pool->mtx);
+	job_push(&pool->finished, &pool->finished_tail, job);
+    }
+    mtx_unlock(&pool->mtx);
+    return 0;
+}
+
+void worker_pool_init(WorkerPool *pool, int count) {
+    pool->count = MAX(1, MIN(count, MAX_WORKERS));
+    pool->stop = 0;
+    pool->todo = pool->todo_tail = 0;
+    pool->finished = pool->finished_tail = 0;
+    pool->pending = 0;
+    mtx_init(&pool->mtx, mtx_plain);
+    cnd_init(&pool->cnd);
+    for(int i = 0; i < pool->count; i++) {
+	thrd_create(pool->threads + i, worker_run, pool);
+    }
+}
+
+void worker_pool_free(WorkerPool *pool) {
+    mtx_lock(&pool->mtx);
+    pool->stop = 1;
+    cnd_signal(&pool->cnd);
+    mtx_unlock(&pool->mtx);
+    for(int i = 0; i < pool->count; i++) {
+	thrd_join(pool->threads[i], NULL);
+    }
+    cnd_destroy(&pool->cnd);
+    mtx_destroy(&pool->mtx);
+}
+
+void worker_pool_submit(WorkerPool *pool, Job *job) {
+    mtx_lock(&pool->mtx);
+    job_push(&pool->todo, &pool->todo_tail, job);
+    pool->pending++;
+    cnd_signal(&pool->cnd);
+    mtx_unlock(&pool->mtx);
+}
+
+// A cancelled job is skipped if no worker picked it up yet, it still
+// comes back through worker_pool_poll so its owner can release it
+void worker_pool_cancel(WorkerPool *pool, Job *job) {
+    mtx_lock(&pool->mtx);
+    job->cancelled = 1;
+    mtx_unlock(&pool->mtx);
+}
+
+// Returns a finished (or cancelled) job without waiting, or 0
+Job* worker_pool_poll(WorkerPool *pool) {
+    mtx_lock(&pool->mtx);
+    Job *job = job_pop(&pool->finished, &pool->finished_tail);
+    if(job) {
+	pool->pending--;
+    }
+    mtx_unlock(&pool->mtx);
+    return job;
+}
+
+int worker_pool_pending(WorkerPool *pool) {
+    mtx_lock(&pool->mtx);
+    int result = pool->pending;
+    mtx_unlock(&pool->mtx);
+    return result;
+}
@@ -0,0 +1,49 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "./third_party/tinycthread.h"
+
+#define MAX_WORKERS 16
+
+
+typedef struct Job Job;
+
+typedef void (*job_func)(Job *job);
+
+// A unit of work. func runs on a worker thread, done runs on the thread
+// that polls the pool and owns the job afterwards.
+struct Job {
+    job_func func;
+    job_func done;
+    int cancelled;
+    Job *next;
+};
+
+typedef struct {
+    thrd_t threads[MAX_WORKERS];
+    int count;
+    int stop;
+    mtx_t mtx;
+    cnd_t cnd;
+    Job *todo;
+    Job *todo_tail;
+    Job *finished;
+    Job *finished_tail;
+    int pending;
+} WorkerPool;
+
+
+void worker_pool_init(WorkerPool *pool, int count);
+
+void worker_pool_free(WorkerPool *pool);
+
+void worker_pool_submit(WorkerPool *pool, Job *job);
+
+void worker_pool_cancel(WorkerPool *pool, Job *job);
+
+Job* worker_pool_poll(WorkerPool *pool);
+
+int worker_pool_pending(WorkerPool *pool);
+
+
+#endif
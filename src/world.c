@@ -1,81 +1,140 @@
+#include <stdlib.h>
+
 #include "world.h"
 #include "config.h"
+#include "util.h"
+#include "profile.h"
 #include "./third_party/noise.h"
 
 
-void create_world(int p, int q, world_func func, void *arg) {
-    int pad = 1;
+#define WORLD_PAD 1
+#define WORLD_SAND 12
+#define WORLD_TREE_MARGIN 4
+#define WORLD_TREE_SIZE (CHUNK_SIZE - 2 * WORLD_TREE_MARGIN)
+
+
+// Sample coordinates (origin + i) * scale, rounded like the float
+// arguments of the scalar noise calls
+static void world_axis(float *axis, int origin, int count, double scale) {
+    for(int i = 0; i < count; i++) {
+	axis[i] = (origin + i) * scale;
+    }
+}
+
+// Works out the ground, plants and trees of every column of region from
+// whole grids of noise
+void world_region(Region *region) {
+    int x0 = region->rp * REGION_SIZE - 1;
+    int z0 = region->rq * REGION_SIZE - 1;
+    RegionColumn *columns = region->columns;
+    float xs[REGION_SPAN];
+    float zs[REGION_SPAN];
+    float *height = (float*)malloc(sizeof(float) * REGION_SPAN * REGION_SPAN);
+    float *noise = (float*)malloc(sizeof(float) * REGION_SPAN * REGION_SPAN);
+
+    world_axis(xs, x0, REGION_SPAN, 0.01);
+    world_axis(zs, z0, REGION_SPAN, 0.01);
+    simplex2_grid(height, xs, REGION_SPAN, zs, REGION_SPAN, 4, 0.5, 2.0);
+    world_axis(xs, x0, REGION_SPAN, -0.01);
+    world_axis(zs, z0, REGION_SPAN, -0.01);
+    simplex2_grid(noise, xs, REGION_SPAN, zs, REGION_SPAN, 2, 0.9, 2.0);
+    for(int i = 0; i < REGION_SPAN * REGION_SPAN; i++) {
+	float f = height[i];
+	float g = noise[i];
+	int mh = g * 32 + 16;
+	int h  = f * mh;
+	columns[i].height = MAX(h, WORLD_SAND);
+	columns[i].plant = 0;
+	columns[i].tree = 0;
+    }
+    if(SHOW_PLANTS) {
+	// grass
+	world_axis(xs, x0, REGION_SPAN, -0.1);
+	world_axis(zs, z0, REGION_SPAN, 0.1);
+	simplex2_grid(noise, xs, REGION_SPAN, zs, REGION_SPAN, 4, 0.8, 2);
+	for(int i = 0; i < REGION_SPAN * REGION_SPAN; i++) {
+	    if(columns[i].height > WORLD_SAND && noise[i] > 0.6) {
+		columns[i].plant = 17;
+	    }
+	}
+	// flowers
+	world_axis(xs, x0, REGION_SPAN, 0.05);
+	world_axis(zs, z0, REGION_SPAN, -0.05);
+	simplex2_grid(noise, xs, REGION_SPAN, zs, REGION_SPAN, 4, 0.8, 2);
+	for(int i = 0; i < REGION_SPAN * REGION_SPAN; i++) {
+	    if(columns[i].height > WORLD_SAND && noise[i] > 0.7) {
+		int x = x0 + i / REGION_SPAN;
+		int z = z0 + i % REGION_SPAN;
+		columns[i].plant = 18 + simplex2(x * 0.1, z * 0.1, 4, 0.8, 2) * 7;
+	    }
+	}
+    }
+    if(SHOW_TREES) {
+	// Trees only grow far enough inside their chunk to keep the leaves in
+	for(int cp = 0; cp < REGION_CHUNKS; cp++) {
+	    for(int cq = 0; cq < REGION_CHUNKS; cq++) {
+		int tx = x0 + 1 + cp * CHUNK_SIZE + WORLD_TREE_MARGIN;
+		int tz = z0 + 1 + cq * CHUNK_SIZE + WORLD_TREE_MARGIN;
+		world_axis(xs, tx, WORLD_TREE_SIZE, 1);
+		world_axis(zs, tz, WORLD_TREE_SIZE, 1);
+		simplex2_grid(noise, xs, WORLD_TREE_SIZE, zs, WORLD_TREE_SIZE, 6, 0.5, 2);
+		for(int i = 0; i < WORLD_TREE_SIZE; i++) {
+		    for(int j = 0; j < WORLD_TREE_SIZE; j++) {
+			RegionColumn *column = region_column(region, tx + i, tz + j);
+			if(column->height > WORLD_SAND && noise[i * WORLD_TREE_SIZE + j] > 0.84) {
+			    column->tree = 1;
+			}
+		    }
+		}
+	    }
+	}
+    }
+    free(height);
+    free(noise);
+}
+
+// Generates the chunk (p, q) into map from the cached columns of its
+// region. Ground and trunks are written as whole column runs, the columns
+// around the chunk only record their ground as the edge of map.
+void create_world(int p, int q, ChunkMap *map) {
+    PROFILE_BEGIN("create_world");
+    int pad = WORLD_PAD;
+    Region *region = region_acquire_chunk(p, q);
     for(int dx = -pad; dx < CHUNK_SIZE + pad; dx++) {
 	for(int dz = -pad; dz < CHUNK_SIZE + pad; dz++) {
-	    int flag = 1;
-	    if(dx < 0 || dx >= CHUNK_SIZE || dz < 0 || dz >= CHUNK_SIZE) {
-		flag = -1;
-	    }
+	    int edge = dx < 0 || dx >= CHUNK_SIZE || dz < 0 || dz >= CHUNK_SIZE;
 	    int x = p * CHUNK_SIZE + dx;
 	    int z = q * CHUNK_SIZE + dz;
-
-	    float f = simplex2( x * 0.01,  z * 0.01, 4, 0.5, 2.0);
-	    float g = simplex2(-x * 0.01, -z * 0.01, 2, 0.9, 2.0);
-
-	    int mh = g * 32 + 16;
-	    int h  = f * mh;
-	    int w  = 1;
-	    int t  = 12;
-	    if(h <= t) {
-		h = t;
-		w = 2;
+	    RegionColumn *column = region_column(region, x, z);
+	    int h = column->height;
+	    int w = h > WORLD_SAND ? 1 : 2;
+	    if(edge) {
+		chunk_map_set_edge(map, x, z, h, w);
+		continue;
 	    }
 	    // sand and grass terrain
-	    for(int y = 0; y < h; y++) {
-		func(x, y, z, w * flag, arg);
+	    chunk_map_fill(map, x, 0, h, z, w);
+	    if(column->plant) {
+		chunk_map_set(map, x, h, z, column->plant);
+	    }
+	    // trees
+	    if(column->tree) {
+		for(int y = h + 3; y < h + 8; y++) {
+		    for(int ox = -3; ox <= 3; ox++) {
+			for(int oz = -3; oz <= 3; oz++) {
+			    int d = (ox * ox) + (oz * oz) +
+				(y - (h + 4)) * (y - (h + 4));
+			    if(d < 11) {
+				chunk_map_set(map, x + ox, y, z + oz, 15);
+			    }
+			}
+		    }
+		}
+		chunk_map_fill(map, x, h, h + 7, z, 5);
 	    }
-            if (w == 1) {
-                if (SHOW_PLANTS) {
-                    // grass
-                    if (simplex2(-x * 0.1, z * 0.1, 4, 0.8, 2) > 0.6) {
-                        func(x, h, z, 17 * flag, arg);
-                    }
-                    // flowers
-                    if (simplex2(x * 0.05, -z * 0.05, 4, 0.8, 2) > 0.7) {
-                        int w = 18 + simplex2(x * 0.1, z * 0.1, 4, 0.8, 2) * 7;
-                        func(x, h, z, w * flag, arg);
-                    }
-                }
-                // trees
-                int ok = SHOW_TREES;
-                if (dx - 4 < 0 || dz - 4 < 0 ||
-                    dx + 4 >= CHUNK_SIZE || dz + 4 >= CHUNK_SIZE)
-                {
-                    ok = 0;
-                }
-                if (ok && simplex2(x, z, 6, 0.5, 2) > 0.84) {
-                    for (int y = h + 3; y < h + 8; y++) {
-                        for (int ox = -3; ox <= 3; ox++) {
-                            for (int oz = -3; oz <= 3; oz++) {
-                                int d = (ox * ox) + (oz * oz) +
-                                    (y - (h + 4)) * (y - (h + 4));
-                                if (d < 11) {
-                                    func(x + ox, y, z + oz, 15, arg);
-                                }
-                            }
-                        }
-                    }
-                    for (int y = h; y < h + 7; y++) {
-                        func(x, y, z, 5, arg);
-                    }
-                }
-            }
-            // clouds
-            if (SHOW_CLOUDS) {
-                for (int y = 64; y < 72; y++) {
-                    if (simplex3(
-                        x * 0.01, y * 0.1, z * 0.01, 8, 0.5, 2) > 0.75)
-                    {
-                        func(x, y, z, 16 * flag, arg);
-                    }
-                }
-            }
 	}
     }
+    region_release(region);
+    PROFILE_END();
 }
 
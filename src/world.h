@@ -1,9 +1,12 @@
 #ifndef WORLD_H
 #define WORLD_H
 
+#include "chunk_map.h"
+#include "region.h"
 
-typedef void (*world_func)(int x, int y, int z, int w, void *arg);
 
-void create_world(int p, int q, world_func func, void *arg);
+void world_region(Region *region);
+
+void create_world(int p, int q, ChunkMap *map);
 
 #endif
@@ -0,0 +1,19 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Checks keep going after a failure so one run reports all of them, main
+// returns TEST_RESULT for ctest
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+	fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+	test_failures++; \
+    } \
+} while(0)
+
+#define TEST_RESULT (test_failures ? 1 : 0)
+
+#endif
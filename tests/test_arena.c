@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "test.h"
+
+// Claims and releases runs of pages at random the way sections come and
+// go in the mesh arena, growing it by compaction when a claim fails like
+// mesh_arena_grow does. Every claim fills its pages with its own id in a
+// stand-in buffer, and compaction copies them into a new one, so a page
+// handed out twice or moved wrong shows up as a page with the wrong id.
+
+#define CAPACITY 64
+#define CLAIMS 256
+#define MAX_CLAIM 24
+#define STEPS 20000
+
+typedef struct {
+    int id;
+    int offset;
+    int size;
+} Claim;
+
+typedef struct {
+    Arena arena;
+    int *pages;
+    Claim claims[CLAIMS];
+    int live[CLAIMS];
+    int held[CLAIMS];
+    int count;
+} World;
+
+static World world;
+
+
+// Copies the pages of a claim into the new buffer and follows the claim
+// there, the same as mesh_arena_move
+static void move_claim(void *owner, int from, int to, int size, void *arg) {
+    Claim *claim = (Claim*)owner;
+    int *pages = (int*)arg;
+    CHECK(claim->offset == from && claim->size == size);
+    memcpy(pages + to, world.pages + from, sizeof(int) * size);
+    claim->offset = to;
+}
+
+static void compact(int capacity) {
+    int *pages = (int*)malloc(sizeof(int) * capacity);
+    for(int i = 0; i < capacity; i++) {
+	pages[i] = -1;
+    }
+    arena_compact(&world.arena, capacity, move_claim, pages);
+    free(world.pages);
+    world.pages = pages;
+}
+
+// Blocks sorted by offset cover the whole buffer, free ones never touch
+// and each claim has the block at its offset
+static int blocks_valid() {
+    Arena *arena = &world.arena;
+    int offset = 0;
+    int used = 0;
+    for(int i = 0; i < arena->count; i++) {
+	ArenaBlock *block = arena->blocks + i;
+	if(block->offset != offset || block->size <= 0) {
+	    return 0;
+	}
+	if(!block->owner && i && !arena->blocks[i - 1].owner) {
+	    return 0;
+	}
+	if(block->owner) {
+	    Claim *claim = (Claim*)block->owner;
+	    if(claim->offset != block->offset || claim->size != block->size) {
+		return 0;
+	    }
+	    used += block->size;
+	}
+	offset += block->size;
+    }
+    return offset == arena->capacity && used == arena->used;
+}
+
+// No two claims share a page and none lost its contents
+static int pages_valid() {
+    for(int i = 0; i < world.count; i++) {
+	Claim *claim = world.claims + world.live[i];
+	for(int j = 0; j < claim->size; j++) {
+	    if(world.pages[claim->offset + j] != claim->id) {
+		return 0;
+	    }
+	}
+    }
+    return 1;
+}
+
+static void claim(int id, int size) {
+    Claim *claim = world.claims + id;
+    int offset = arena_claim(&world.arena, size, claim);
+    if(offset < 0) {
+	// mesh_arena_grow, double while it would be over three quarters full
+	int capacity = world.arena.capacity;
+	while(capacity - world.arena.used < size + capacity / 4) {
+	    capacity *= 2;
+	}
+	compact(capacity);
+	CHECK(pages_valid());
+	offset = arena_claim(&world.arena, size, claim);
+    }
+    CHECK(offset >= 0);
+    if(offset < 0) {
+	return;
+    }
+    claim->id = id;
+    claim->offset = offset;
+    claim->size = size;
+    for(int j = 0; j < size; j++) {
+	world.pages[offset + j] = id;
+    }
+    world.live[world.count++] = id;
+    world.held[id] = 1;
+}
+
+static void release(int index) {
+    Claim *claim = world.claims + world.live[index];
+    arena_release(&world.arena, claim->offset);
+    world.held[claim->id] = 0;
+    world.live[index] = world.live[--world.count];
+}
+
+int main() {
+    srand(23);
+    arena_init(&world.arena, CAPACITY);
+    world.pages = (int*)malloc(sizeof(int) * CAPACITY);
+    for(int step = 0; step < STEPS; step++) {
+	int op = rand() % 16;
+	if(op < 8 && world.count < CLAIMS) {
+	    // Ids of released claims come back, like recycled sections
+	    int id = rand() % CLAIMS;
+	    while(world.held[id]) {
+		id = (id + 1) % CLAIMS;
+	    }
+	    claim(id, 1 + rand() % MAX_CLAIM);
+	}
+	else if(op < 15 && world.count) {
+	    release(rand() % world.count);
+	}
+	else {
+	    // Compacting without growing moves the claims down into the gaps
+	    compact(world.arena.capacity);
+	}
+	CHECK(blocks_valid());
+	CHECK(pages_valid());
+    }
+
+    while(world.count) {
+	release(rand() % world.count);
+    }
+    CHECK(world.arena.used == 0);
+    CHECK(world.arena.count == 1);
+    CHECK(!world.arena.blocks[0].owner);
+    CHECK(world.arena.blocks[0].offset == 0);
+    CHECK(world.arena.blocks[0].size == world.arena.capacity);
+    arena_free(&world.arena);
+    free(world.pages);
+    return TEST_RESULT;
+}
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+
+#include "matrix.h"
+#include "util.h"
+#include "test.h"
+
+// frustum_box against the view volume of the matrices render_chunks
+// builds. A box with a corner in the clip volume must never be culled, a
+// box with all its corners past one of the planes always is.
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define FOV 65
+#define RADIUS 10
+#define CAMERA_X 100.5
+#define CAMERA_Y 50.5
+#define CAMERA_Z -200.5
+#define RANDOM_BOXES 20000
+
+typedef struct {
+    float matrix[16];
+    float planes[6][4];
+} View;
+
+
+static float random_float(float a, float b) {
+    return a + (b - a) * (rand() / (float)RAND_MAX);
+}
+
+static void view_init(View *view, float rx, float ry, int ortho) {
+    set_matrix_3d(view->matrix, WIDTH, HEIGHT, CAMERA_X, CAMERA_Y, CAMERA_Z,
+		  rx, ry, FOV, ortho, RADIUS);
+    frustum_planes(view->planes, view->matrix);
+}
+
+// Bit i of the result is set when the point is further than margin past
+// plane i, in the order frustum_planes keeps them. The margin scales with
+// w so that corners on a plane count as neither inside nor outside.
+static int outside_planes(View *view, float x, float y, float z, float margin) {
+    float point[4] = {x, y, z, 1};
+    float clip[4];
+    mat_vec_multiply(clip, view->matrix, point);
+    float w = clip[3] + margin * (fabsf(clip[3]) + 1);
+    return (clip[0] < -w) << 0 | (clip[0] > w) << 1 |
+	(clip[1] < -w) << 2 | (clip[1] > w) << 3 |
+	(clip[2] < -w) << 4 | (clip[2] > w) << 5;
+}
+
+// 1 when a corner of the box is inside the clip volume, -1 when every
+// corner is past the same plane and 0 when the corners can't tell
+static int box_oracle(View *view, float x0, float y0, float z0, float x1, float y1, float z1) {
+    int all = 0x3f;
+    for(int i = 0; i < 8; i++) {
+	float x = i & 1 ? x1 : x0;
+	float y = i & 2 ? y1 : y0;
+	float z = i & 4 ? z1 : z0;
+	if(!outside_planes(view, x, y, z, -1e-3)) {
+	    return 1;
+	}
+	all &= outside_planes(view, x, y, z, 1e-3);
+    }
+    return all ? -1 : 0;
+}
+
+// A box of the given half size centered at distance along the view
+// direction, offset sideways and up in view space
+static int ahead(View *view, float distance, float side, float up, float half) {
+    // Camera basis from the rows of the view rotation, the same for both
+    // projections up to scale
+    float right[3] = {view->matrix[0], view->matrix[4], view->matrix[8]};
+    float top[3] = {view->matrix[1], view->matrix[5], view->matrix[9]};
+    normalize(right + 0, right + 1, right + 2);
+    normalize(top + 0, top + 1, top + 2);
+    float forward[3] = {
+	top[1] * right[2] - top[2] * right[1],
+	top[2] * right[0] - top[0] * right[2],
+	top[0] * right[1] - top[1] * right[0]
+    };
+    float x = CAMERA_X + forward[0] * distance + right[0] * side + top[0] * up;
+    float y = CAMERA_Y + forward[1] * distance + right[1] * side + top[1] * up;
+    float z = CAMERA_Z + forward[2] * distance + right[2] * side + top[2] * up;
+    return frustum_box(view->planes, 6, x - half, y - half, z - half, x + half, y + half, z + half);
+}
+
+static void check_view(View *view, int ortho) {
+    // Inside, straight ahead and filling the view
+    CHECK(ahead(view, 20, 0, 0, 1));
+    CHECK(ahead(view, 20, 0, 0, 200));
+    // Behind the camera, past the far plane and far off to each side
+    CHECK(ortho || !ahead(view, -20, 0, 0, 1));
+    CHECK(!ahead(view, RADIUS * 32 + 200, 0, 0, 1));
+    CHECK(!ahead(view, 20, 1000, 0, 1));
+    CHECK(!ahead(view, 20, -1000, 0, 1));
+    CHECK(!ahead(view, 20, 0, 1000, 1));
+    CHECK(!ahead(view, 20, 0, -1000, 1));
+    // Straddling the side, top and near planes
+    float top = ortho ? ortho : 20 * tanf(FOV * PI / 360);
+    float edge = top * WIDTH / HEIGHT;
+    CHECK(ahead(view, 20, edge, 0, 3));
+    CHECK(ahead(view, 20, -edge, 0, 3));
+    CHECK(ahead(view, 20, 0, top, 3));
+    CHECK(ahead(view, 20, 0, -top, 3));
+    CHECK(ahead(view, 0, 0, 0, 1));
+
+    for(int i = 0; i < RANDOM_BOXES; i++) {
+	float x0 = CAMERA_X + random_float(-400, 400);
+	float y0 = CAMERA_Y + random_float(-100, 100);
+	float z0 = CAMERA_Z + random_float(-400, 400);
+	float size = random_float(0.1, 40);
+	float x1 = x0 + size;
+	float y1 = y0 + random_float(0.1, 40);
+	float z1 = z0 + size;
+	int expected = box_oracle(view, x0, y0, z0, x1, y1, z1);
+	int visible = frustum_box(view->planes, 6, x0, y0, z0, x1, y1, z1);
+	if(expected > 0) {
+	    CHECK(visible);
+	}
+	else if(expected < 0) {
+	    CHECK(!visible);
+	}
+    }
+}
+
+int main() {
+    static const float angles[][2] = {
+	{0, 0}, {1.2, 0.3}, {-2.5, -0.7}, {3.1, 1.4}, {0.4, -1.5}
+    };
+    srand(5);
+    for(int i = 0; i < 5; i++) {
+	View view;
+	view_init(&view, angles[i][0], angles[i][1], 0);
+	check_view(&view, 0);
+	view_init(&view, angles[i][0], angles[i][1], 64);
+	check_view(&view, 64);
+    }
+    return TEST_RESULT;
+}
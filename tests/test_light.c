@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "light.h"
+#include "test.h"
+
+// Drives a LightEngine through its callbacks over a small world of
+// chunks, with the same calls main.c makes for lights toggled on blocks,
+// block edits and chunks loading and unloading. After every change the
+// levels must match a full recompute from the sources that are left.
+
+#define SIZE 8			// Blocks per chunk side, small to cross seams often
+#define CHUNKS 4
+#define WIDTH (SIZE * CHUNKS)
+#define HEIGHT 16
+#define STEPS 2000
+
+typedef struct {
+    char level[WIDTH][HEIGHT][WIDTH];
+    char opaque[WIDTH][HEIGHT][WIDTH];
+    char base[WIDTH][HEIGHT][WIDTH];
+    char source[WIDTH][HEIGHT][WIDTH];
+    char loaded[CHUNKS][CHUNKS];
+    unsigned int rng;
+} World;
+
+static World world;
+
+
+static int random_int(int n) {
+    world.rng = world.rng * 1103515245u + 12345u;
+    return (world.rng >> 16) % n;
+}
+
+static int loaded(int x, int y, int z) {
+    if(x < 0 || x >= WIDTH || z < 0 || z >= WIDTH || y < 0 || y >= HEIGHT) {
+	return 0;
+    }
+    return world.loaded[x / SIZE][z / SIZE];
+}
+
+static int world_get(int x, int y, int z, void *arg) {
+    (void)arg;
+    return loaded(x, y, z) ? world.level[x][y][z] : 0;
+}
+
+static void world_set(int x, int y, int z, int w, void *arg) {
+    (void)arg;
+    if(loaded(x, y, z)) {
+	world.level[x][y][z] = w;
+    }
+}
+
+static int world_open(int x, int y, int z, void *arg) {
+    (void)arg;
+    return loaded(x, y, z) && !world.opaque[x][y][z];
+}
+
+// Levels from scratch: a breadth first fill from every source of the
+// loaded chunks, as if they had all been placed at once
+static void recompute(char expected[WIDTH][HEIGHT][WIDTH]) {
+    static int queue[WIDTH * HEIGHT * WIDTH][3];
+    static const int offsets[6][3] = {
+	{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}
+    };
+    int head = 0;
+    int tail = 0;
+    memset(expected, 0, WIDTH * HEIGHT * WIDTH);
+    for(int x = 0; x < WIDTH; x++) {
+	for(int y = 0; y < HEIGHT; y++) {
+	    for(int z = 0; z < WIDTH; z++) {
+		if(world.source[x][y][z] && loaded(x, y, z)) {
+		    expected[x][y][z] = LIGHT_SOURCE;
+		    queue[tail][0] = x;
+		    queue[tail][1] = y;
+		    queue[tail][2] = z;
+		    tail++;
+		}
+	    }
+	}
+    }
+    while(head < tail) {
+	int *node = queue[head++];
+	int w = expected[node[0]][node[1]][node[2]];
+	for(int i = 0; i < 6; i++) {
+	    int x = node[0] + offsets[i][0];
+	    int y = node[1] + offsets[i][1];
+	    int z = node[2] + offsets[i][2];
+	    if(w > 1 && world_open(x, y, z, 0) && expected[x][y][z] < w - 1) {
+		expected[x][y][z] = w - 1;
+		queue[tail][0] = x;
+		queue[tail][1] = y;
+		queue[tail][2] = z;
+		tail++;
+	    }
+	}
+    }
+}
+
+static int matches_recompute() {
+    static char expected[WIDTH][HEIGHT][WIDTH];
+    recompute(expected);
+    for(int x = 0; x < WIDTH; x++) {
+	for(int y = 0; y < HEIGHT; y++) {
+	    for(int z = 0; z < WIDTH; z++) {
+		if(loaded(x, y, z) && world.level[x][y][z] != expected[x][y][z]) {
+		    return 0;
+		}
+	    }
+	}
+    }
+    return 1;
+}
+
+// on_light in main.c
+static void toggle_light(LightEngine *engine, int x, int y, int z) {
+    if(world_get(x, y, z, 0) == LIGHT_SOURCE) {
+	light_remove(engine, x, y, z);
+	light_refill(engine, x, y, z);
+	world.source[x][y][z] = 0;
+    }
+    else {
+	light_add_source(engine, x, y, z);
+	world.source[x][y][z] = 1;
+    }
+}
+
+// set_block and light_block in main.c, an edit takes away the light of
+// the block it lands on
+static void set_block(LightEngine *engine, int x, int y, int z, int opaque) {
+    world.opaque[x][y][z] = opaque;
+    world.source[x][y][z] = 0;
+    if(world_get(x, y, z, 0)) {
+	light_remove(engine, x, y, z);
+    }
+    if(!opaque) {
+	light_refill(engine, x, y, z);
+    }
+}
+
+// clear_chunk_light and delete_chunk in main.c
+static void unload_chunk(LightEngine *engine, int p, int q) {
+    for(int lx = 0; lx < SIZE; lx++) {
+	for(int lz = 0; lz < SIZE; lz++) {
+	    if(lx && lx != SIZE - 1 && lz && lz != SIZE - 1) {
+		continue;
+	    }
+	    for(int y = 0; y < HEIGHT; y++) {
+		int x = p * SIZE + lx;
+		int z = q * SIZE + lz;
+		if(world.level[x][y][z]) {
+		    light_remove(engine, x, y, z);
+		}
+	    }
+	}
+    }
+    world.loaded[p][q] = 0;
+    for(int lx = 0; lx < SIZE; lx++) {
+	for(int y = 0; y < HEIGHT; y++) {
+	    for(int lz = 0; lz < SIZE; lz++) {
+		world.level[p * SIZE + lx][y][q * SIZE + lz] = 0;
+		world.source[p * SIZE + lx][y][q * SIZE + lz] = 0;
+	    }
+	}
+    }
+}
+
+// create_chunk and seed_chunk_light in main.c, the chunk comes back as
+// generated and its neighbors light it
+static void load_chunk(LightEngine *engine, int p, int q) {
+    for(int lx = 0; lx < SIZE; lx++) {
+	for(int y = 0; y < HEIGHT; y++) {
+	    for(int lz = 0; lz < SIZE; lz++) {
+		int x = p * SIZE + lx;
+		int z = q * SIZE + lz;
+		world.opaque[x][y][z] = world.base[x][y][z];
+	    }
+	}
+    }
+    world.loaded[p][q] = 1;
+    for(int x = p * SIZE - 1; x <= p * SIZE + SIZE; x++) {
+	for(int z = q * SIZE - 1; z <= q * SIZE + SIZE; z++) {
+	    if(x / SIZE == p && z / SIZE == q) {
+		continue;
+	    }
+	    for(int y = 0; y < HEIGHT; y++) {
+		if(world_get(x, y, z, 0) > 1) {
+		    light_seed(engine, x, y, z);
+		}
+	    }
+	}
+    }
+}
+
+static void run(LightEngine *engine, int budget) {
+    for(int step = 0; step < STEPS; step++) {
+	int x = random_int(WIDTH);
+	int y = random_int(HEIGHT);
+	int z = random_int(WIDTH);
+	int p = random_int(CHUNKS);
+	int q = random_int(CHUNKS);
+	int op = random_int(16);
+	if(op < 6) {
+	    if(loaded(x, y, z)) {
+		toggle_light(engine, x, y, z);
+	    }
+	}
+	else if(op < 14) {
+	    if(loaded(x, y, z)) {
+		set_block(engine, x, y, z, !world.opaque[x][y][z]);
+	    }
+	}
+	else if(world.loaded[p][q]) {
+	    unload_chunk(engine, p, q);
+	}
+	else {
+	    load_chunk(engine, p, q);
+	}
+	// With a budget the edits land while earlier ones are still queued,
+	// like they do across frames, and the levels are only compared
+	// once the queues ran dry
+	if(budget) {
+	    light_update(engine, budget);
+	    if(step % 50 == 49) {
+		while(light_update(engine, budget));
+		CHECK(matches_recompute());
+	    }
+	}
+	else {
+	    light_update(engine, WIDTH * HEIGHT * WIDTH * 8);
+	    CHECK(!light_pending(engine));
+	    CHECK(matches_recompute());
+	}
+    }
+}
+
+int main() {
+    static const int budgets[] = {0, 200, 20};
+    for(int i = 0; i < 3; i++) {
+	memset(&world, 0, sizeof(world));
+	world.rng = 17 + i;
+	for(int x = 0; x < WIDTH; x++) {
+	    for(int y = 0; y < HEIGHT; y++) {
+		for(int z = 0; z < WIDTH; z++) {
+		    world.base[x][y][z] = y < 2 || random_int(5) == 0;
+		}
+	    }
+	}
+	memcpy(world.opaque, world.base, sizeof(world.opaque));
+	memset(world.loaded, 1, sizeof(world.loaded));
+	LightEngine engine;
+	light_init(&engine, world_get, world_set, world_open, 0);
+	run(&engine, budgets[i]);
+	light_free(&engine);
+    }
+    return TEST_RESULT;
+}
@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "./third_party/noise.h"
+#include "config.h"
+#include "chunk_map.h"
+#include "map.h"
+#include "region.h"
+#include "world.h"
+#include "sky.h"
+#include "mesh.h"
+#include "util.h"
+#include "test.h"
+
+// Remeshes a few snapshots thousands of times through the thread's
+// reused MeshContext. Every mesh must match the one a fresh context makes
+// of the same snapshot, and once the first round has sized the scratch
+// the resident set must stay flat. Greedy quads must shade like the plain
+// faces they replace.
+
+#define RADIUS 2
+#define SIZE (2 * RADIUS + 1)
+#define CENTERS ((SIZE - 2) * (SIZE - 2))
+#define VARIANTS 3
+#define REMESHES 2000
+#define RSS_SLACK_KB 1024
+
+typedef struct {
+    ChunkMap map;
+    Map lights;
+    SkyMap sky;
+} Snapshot;
+
+// Whole chunks and a few scattered sections, so the reused context
+// meshes after chunks that dirtied more or other rows than it needs
+static const unsigned int variants[VARIANTS] = {
+    ALL_SECTIONS, (1u << 2) | (1u << 3), 1u << 1
+};
+
+
+static long max_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void mesh_sections(MeshContext *ctx, Mesh meshes[CHUNK_SECTIONS], unsigned int sections, Snapshot *snapshot) {
+    memset(meshes, 0, sizeof(Mesh) * CHUNK_SECTIONS);
+    mesh_chunk(ctx, meshes, sections, &snapshot->map, &snapshot->lights, &snapshot->sky);
+}
+
+static int mesh_equal(Mesh *a, Mesh *b) {
+    if(a->faces != b->faces || a->cutout != b->cutout) {
+	return 0;
+    }
+    if(!a->faces) {
+	return 1;
+    }
+    if(a->miny != b->miny || a->maxy != b->maxy) {
+	return 0;
+    }
+    return !memcmp(a->data, b->data, sizeof(uint32_t) * MESH_FACE_WORDS * a->faces);
+}
+
+static int meshes_equal(Mesh a[CHUNK_SECTIONS], Mesh b[CHUNK_SECTIONS]) {
+    for(int i = 0; i < CHUNK_SECTIONS; i++) {
+	if(!mesh_equal(a + i, b + i)) {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+// Position and face of a packed vertex, the bits below ao and light
+#define VERTEX_KEY(word) ((word) & 0xffffff)
+#define VERTEX_FACE(word) (((word) >> 21) & 7)
+
+// Orders corners by position and face first
+static int vertex_compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    x = VERTEX_KEY(x) << 8 | x >> 24;
+    y = VERTEX_KEY(y) << 8 | y >> 24;
+    return x < y ? -1 : x > y;
+}
+
+// Merged quads must cover the faces of the plain mesh exactly, with each
+// of their corners shaded like the plain faces that share it
+static int greedy_matches_plain(Mesh *plain, Mesh *greedy) {
+    uint32_t *corners = (uint32_t*)malloc(sizeof(uint32_t) * 4 * (plain->faces + 1));
+    int count = 0;
+    int area = 0;
+    for(int i = 0; i < plain->faces; i++) {
+	uint32_t *d = plain->data + i * MESH_FACE_WORDS;
+	if(VERTEX_FACE(d[0]) == CUBE_PLANT_FACE) {
+	    continue;
+	}
+	for(int j = 0; j < 4; j++) {
+	    corners[count++] = d[j * CUBE_VERTEX_WORDS];
+	}
+	area--;
+    }
+    qsort(corners, count, sizeof(uint32_t), vertex_compare);
+    int result = 1;
+    for(int i = 0; i < greedy->faces; i++) {
+	uint32_t *d = greedy->data + i * MESH_FACE_WORDS;
+	if(VERTEX_FACE(d[0]) == CUBE_PLANT_FACE) {
+	    continue;
+	}
+	int lo[3] = {63, 511, 63};
+	int hi[3] = {0, 0, 0};
+	for(int j = 0; j < 4; j++) {
+	    uint32_t word = d[j * CUBE_VERTEX_WORDS];
+	    int p[3] = {word & 63, (word >> 6) & 511, (word >> 15) & 63};
+	    for(int k = 0; k < 3; k++) {
+		lo[k] = MIN(lo[k], p[k]);
+		hi[k] = MAX(hi[k], p[k]);
+	    }
+	    // First plain corner at the same position and face
+	    int a = 0;
+	    int b = count;
+	    while(a < b) {
+		int m = (a + b) / 2;
+		if(VERTEX_KEY(corners[m]) < VERTEX_KEY(word)) {
+		    a = m + 1;
+		}
+		else {
+		    b = m;
+		}
+	    }
+	    // Plain faces can disagree on a shared corner, one of them is
+	    // enough
+	    while(a < count && VERTEX_KEY(corners[a]) == VERTEX_KEY(word) && corners[a] != word) {
+		a++;
+	    }
+	    if(a == count || corners[a] != word) {
+		result = 0;
+	    }
+	}
+	int size = 1;
+	for(int k = 0; k < 3; k++) {
+	    size *= MAX(1, hi[k] - lo[k]);
+	}
+	area += size;
+    }
+    free(corners);
+    return result && !area;
+}
+
+static void meshes_free(Mesh meshes[CHUNK_SECTIONS]) {
+    for(int i = 0; i < CHUNK_SECTIONS; i++) {
+	mesh_free(meshes + i);
+    }
+}
+
+int main() {
+    static ChunkMap maps[SIZE][SIZE];
+    static Map lights[SIZE][SIZE];
+    static SkyMap skies[SIZE][SIZE];
+    static Snapshot snapshots[CENTERS];
+    static Mesh expected[CENTERS][VARIANTS][CHUNK_SECTIONS];
+    seed(7);
+    region_init();
+    mesh_thread_init();
+    for(int a = 0; a < SIZE; a++) {
+	for(int b = 0; b < SIZE; b++) {
+	    int dx = (a - RADIUS) * CHUNK_SIZE;
+	    int dz = (b - RADIUS) * CHUNK_SIZE;
+	    chunk_map_alloc(&maps[a][b], dx, dz);
+	    create_world(a - RADIUS, b - RADIUS, &maps[a][b]);
+	    sky_alloc(&skies[a][b], dx, dz);
+	    sky_compute(&skies[a][b], &maps[a][b]);
+	    // A light on the ground in every chunk
+	    map_alloc(&lights[a][b], dx - 1, 0, dz - 1, 0xf);
+	    int y = sky_height(&skies[a][b], dx + 5, dz + 5);
+	    map_set(&lights[a][b], dx + 5, y, dz + 5, 15);
+	    map_set(&lights[a][b], dx + 6, y, dz + 5, 14);
+	}
+    }
+    for(int i = 0; i < CENTERS; i++) {
+	int a = i / (SIZE - 2) + 1;
+	int b = i % (SIZE - 2) + 1;
+	ChunkMap *block_maps[3][3];
+	Map *light_maps[3][3];
+	SkyMap *sky_maps[3][3];
+	for(int dp = -1; dp <= 1; dp++) {
+	    for(int dq = -1; dq <= 1; dq++) {
+		block_maps[dp + 1][dq + 1] = &maps[a + dp][b + dq];
+		light_maps[dp + 1][dq + 1] = &lights[a + dp][b + dq];
+		sky_maps[dp + 1][dq + 1] = &skies[a + dp][b + dq];
+	    }
+	}
+	mesh_snapshot(&snapshots[i].map, block_maps);
+	mesh_snapshot_lights(&snapshots[i].lights, light_maps);
+	mesh_snapshot_sky(&snapshots[i].sky, sky_maps);
+	for(int v = 0; v < VARIANTS; v++) {
+	    MeshContext fresh;
+	    mesh_context_init(&fresh);
+	    mesh_sections(&fresh, expected[i][v], variants[v], snapshots + i);
+	    mesh_context_free(&fresh);
+	}
+    }
+
+    MeshContext *ctx = mesh_context();
+    long warm = 0;
+    for(int n = 0; n < REMESHES; n++) {
+	int i = n % CENTERS;
+	int v = (n / CENTERS) % VARIANTS;
+	Mesh meshes[CHUNK_SECTIONS];
+	mesh_sections(ctx, meshes, variants[v], snapshots + i);
+	CHECK(meshes_equal(meshes, expected[i][v]));
+	meshes_free(meshes);
+	if(n == CENTERS * VARIANTS - 1) {
+	    warm = max_rss();
+	}
+    }
+    CHECK(max_rss() - warm <= RSS_SLACK_KB);
+
+    // The other meshing algorithm goes through the same scratch
+    for(int n = 0; n < CENTERS * 4; n++) {
+	Snapshot *snapshot = snapshots + n % CENTERS;
+	int y0 = (n % 5) * SECTION_HEIGHT;
+	int y1 = MIN(y0 + SECTION_HEIGHT * (1 + n % 3), snapshot->map.top);
+	if(y0 >= y1) {
+	    continue;
+	}
+	MeshContext fresh;
+	Mesh a = {0}, b = {0};
+	mesh_context_init(&fresh);
+	if(GREEDY_MESHING) {
+	    compute_chunk(&fresh, &a, &snapshot->map, &snapshot->lights, &snapshot->sky, y0, y1);
+	    compute_chunk(ctx, &b, &snapshot->map, &snapshot->lights, &snapshot->sky, y0, y1);
+	}
+	else {
+	    compute_chunk_greedy(&fresh, &a, &snapshot->map, &snapshot->lights, &snapshot->sky, y0, y1);
+	    compute_chunk_greedy(ctx, &b, &snapshot->map, &snapshot->lights, &snapshot->sky, y0, y1);
+	}
+	mesh_context_free(&fresh);
+	CHECK(mesh_equal(&a, &b));
+	mesh_free(&a);
+	mesh_free(&b);
+    }
+
+    for(int i = 0; i < CENTERS; i++) {
+	Snapshot *snapshot = snapshots + i;
+	Mesh plain = {0}, greedy = {0};
+	compute_chunk(ctx, &plain, &snapshot->map, &snapshot->lights, &snapshot->sky, 0, CHUNK_HEIGHT);
+	compute_chunk_greedy(ctx, &greedy, &snapshot->map, &snapshot->lights, &snapshot->sky, 0, CHUNK_HEIGHT);
+	CHECK(greedy.faces < plain.faces);
+	CHECK(greedy_matches_plain(&plain, &greedy));
+	mesh_free(&plain);
+	mesh_free(&greedy);
+    }
+
+    for(int i = 0; i < CENTERS; i++) {
+	for(int v = 0; v < VARIANTS; v++) {
+	    meshes_free(expected[i][v]);
+	}
+	chunk_map_free(&snapshots[i].map);
+	map_free(&snapshots[i].lights);
+	sky_free(&snapshots[i].sky);
+    }
+    for(int a = 0; a < SIZE; a++) {
+	for(int b = 0; b < SIZE; b++) {
+	    chunk_map_free(&maps[a][b]);
+	    map_free(&lights[a][b]);
+	    sky_free(&skies[a][b]);
+	}
+    }
+    region_free();
+    return TEST_RESULT;
+}
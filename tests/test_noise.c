@@ -0,0 +1,107 @@
+#include <stdlib.h>
+
+#include "./third_party/noise.h"
+#include "test.h"
+
+// The vector grids must give exactly what simplex2 and simplex3 give for
+// every sample, on the AVX2 path and on the SSE2 one. Widths that are not
+// a multiple of the lanes exercise the partial vectors at the row ends.
+
+#define MAX_WIDTH 66
+#define ROUNDS 40
+
+typedef struct {
+    int octaves;
+    float persistence;
+    float lacunarity;
+} Octaves;
+
+// The settings world generation and the clouds use
+static const Octaves settings[] = {
+    {4, 0.5, 2}, {2, 0.9, 2}, {4, 0.8, 2}, {6, 0.5, 2}, {8, 0.5, 2}, {1, 0.5, 2}
+};
+
+static const int widths[] = {1, 2, 3, 5, 7, 8, 9, 13, 16, 17, 31, 33, MAX_WIDTH};
+
+#define SETTINGS (int)(sizeof(settings) / sizeof(settings[0]))
+#define WIDTHS (int)(sizeof(widths) / sizeof(widths[0]))
+
+
+static float random_float(float a, float b) {
+    return a + (b - a) * (rand() / (float)RAND_MAX);
+}
+
+// Coordinates like world_axis makes them, whole blocks scaled by a
+// possibly negative frequency, or anywhere around the origin
+static void random_axis(float *axis, int n) {
+    if(rand() % 2) {
+	int start = rand() % 20000 - 10000;
+	float scale = rand() % 2 ? 0.01 : -0.01;
+	for(int i = 0; i < n; i++) {
+	    axis[i] = (start + i) * scale;
+	}
+    }
+    else {
+	for(int i = 0; i < n; i++) {
+	    axis[i] = random_float(-300, 300);
+	}
+    }
+}
+
+static int grid2_matches(int nx, int ny, const Octaves *o) {
+    static float out[MAX_WIDTH * MAX_WIDTH];
+    float xs[MAX_WIDTH];
+    float ys[MAX_WIDTH];
+    random_axis(xs, nx);
+    random_axis(ys, ny);
+    simplex2_grid(out, xs, nx, ys, ny, o->octaves, o->persistence, o->lacunarity);
+    for(int i = 0; i < nx; i++) {
+	for(int j = 0; j < ny; j++) {
+	    float expected = simplex2(xs[i], ys[j], o->octaves, o->persistence, o->lacunarity);
+	    if(out[i * ny + j] != expected) {
+		return 0;
+	    }
+	}
+    }
+    return 1;
+}
+
+static int grid3_matches(int nx, int ny, int nz, const Octaves *o) {
+    static float out[4 * 4 * MAX_WIDTH];
+    float xs[4];
+    float ys[4];
+    float zs[MAX_WIDTH];
+    random_axis(xs, nx);
+    random_axis(ys, ny);
+    random_axis(zs, nz);
+    simplex3_grid(out, xs, nx, ys, ny, zs, nz, o->octaves, o->persistence, o->lacunarity);
+    for(int i = 0; i < nx; i++) {
+	for(int j = 0; j < ny; j++) {
+	    for(int k = 0; k < nz; k++) {
+		float expected = simplex3(xs[i], ys[j], zs[k], o->octaves, o->persistence, o->lacunarity);
+		if(out[(i * ny + j) * nz + k] != expected) {
+		    return 0;
+		}
+	    }
+	}
+    }
+    return 1;
+}
+
+int main() {
+    seed(3);
+    srand(11);
+    for(int avx2 = 1; avx2 >= 0; avx2--) {
+	simplex_grid_avx2(avx2);
+	for(int round = 0; round < ROUNDS; round++) {
+	    const Octaves *o = settings + round % SETTINGS;
+	    for(int w = 0; w < WIDTHS; w++) {
+		int nx = widths[(w + round) % WIDTHS];
+		CHECK(grid2_matches(nx, widths[w], o));
+		CHECK(grid3_matches(1 + round % 4, 1 + w % 4, widths[w], o));
+	    }
+	}
+    }
+    simplex_grid_avx2(1);
+    return TEST_RESULT;
+}
@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "./third_party/noise.h"
+#include "config.h"
+#include "chunk_index.h"
+#include "chunk_map.h"
+#include "region.h"
+#include "world.h"
+#include "util.h"
+#include "test.h"
+
+// Flies in a straight line, loading chunks out to the create radius and
+// evicting them past the delete radius the way force_chunks and
+// delete_chunks do in main.c. Every step inserts keys the index has never
+// seen and leaves tombstones behind, so once the first chunks are evicted
+// the index, the live chunks and the memory they hold must stop growing.
+
+#define CREATE_RADIUS 3
+#define DELETE_RADIUS 5
+#define LIVE_MAX ((2 * DELETE_RADIUS + 1) * (2 * DELETE_RADIUS + 1))
+#define WARM_UP (2 * DELETE_RADIUS + 2)
+#define STEPS 400
+// Lazily touched heap and region cache pages come in well under this,
+// a chunk map leaked on every eviction goes past it within 20 steps
+#define RSS_SLACK_KB 16384
+
+typedef struct {
+    ChunkIndex index;
+    unsigned long bytes;
+} Soak;
+
+
+static long max_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void load_chunk(Soak *soak, int p, int q) {
+    ChunkMap *map = (ChunkMap*)malloc(sizeof(ChunkMap));
+    chunk_map_alloc(map, p * CHUNK_SIZE, q * CHUNK_SIZE);
+    create_world(p, q, map);
+    chunk_index_set(&soak->index, p, q, map);
+    soak->bytes += chunk_map_bytes(map);
+}
+
+static void evict_chunk(Soak *soak, int p, int q) {
+    ChunkMap *map = (ChunkMap*)chunk_index_get(&soak->index, p, q);
+    chunk_index_remove(&soak->index, p, q);
+    soak->bytes -= chunk_map_bytes(map);
+    chunk_map_free(map);
+    free(map);
+    CHECK(!chunk_index_get(&soak->index, p, q));
+}
+
+// One chunk per step, so everything to evict is within one chunk past
+// the delete radius
+static void step(Soak *soak, int p, int q) {
+    int r = DELETE_RADIUS + 1;
+    for(int a = p - r; a <= p + r; a++) {
+	for(int b = q - r; b <= q + r; b++) {
+	    int far = MAX(ABS(a - p), ABS(b - q)) > DELETE_RADIUS;
+	    if(far && chunk_index_get(&soak->index, a, b)) {
+		evict_chunk(soak, a, b);
+	    }
+	}
+    }
+    for(int a = p - CREATE_RADIUS; a <= p + CREATE_RADIUS; a++) {
+	for(int b = q - CREATE_RADIUS; b <= q + CREATE_RADIUS; b++) {
+	    if(!chunk_index_get(&soak->index, a, b)) {
+		load_chunk(soak, a, b);
+	    }
+	}
+    }
+}
+
+int main() {
+    static Soak soak;
+    seed(99);
+    region_init();
+    chunk_index_alloc(&soak.index, 0xff);
+    long warm = 0;
+    unsigned long warm_bytes = 0;
+    unsigned int warm_mask = 0;
+    for(int i = 0; i < STEPS; i++) {
+	step(&soak, i, 0);
+	CHECK(soak.index.size <= LIVE_MAX);
+	CHECK(soak.index.used <= soak.index.mask / 2 + 1);
+	if(i == WARM_UP) {
+	    warm = max_rss();
+	    warm_bytes = soak.bytes;
+	    warm_mask = soak.index.mask;
+	}
+	else if(i > WARM_UP) {
+	    // At most the one doubling the live chunks ask for, tombstones
+	    // alone never grow the table
+	    CHECK(soak.index.mask <= (warm_mask << 1 | 1));
+	    CHECK(soak.index.mask < LIVE_MAX * 8);
+	    // The terrain changes along the way, the packed bits barely do
+	    CHECK(soak.bytes <= warm_bytes + warm_bytes / 4);
+	}
+    }
+    CHECK(max_rss() - warm <= RSS_SLACK_KB);
+
+    int p = STEPS - 1;
+    for(int a = p - DELETE_RADIUS; a <= p + DELETE_RADIUS; a++) {
+	for(int b = -DELETE_RADIUS; b <= DELETE_RADIUS; b++) {
+	    if(chunk_index_get(&soak.index, a, b)) {
+		evict_chunk(&soak, a, b);
+	    }
+	}
+    }
+    CHECK(soak.index.size == 0);
+    CHECK(soak.bytes == 0);
+    chunk_index_free(&soak.index);
+    region_free();
+    return TEST_RESULT;
+}
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "./third_party/noise.h"
+#include "config.h"
+#include "chunk_map.h"
+#include "region.h"
+#include "world.h"
+#include "sky.h"
+#include "worker.h"
+#include "test.h"
+
+// Chunks generated on the worker pool must come out byte for byte the same
+// as create_world run inline for the same (p, q), whatever the order the
+// workers pick them up in and while they share the region cache.
+
+#define RADIUS 4
+#define SIZE (2 * RADIUS + 1)
+#define COUNT (SIZE * SIZE)
+
+typedef struct {
+    Job job;
+    int p;
+    int q;
+    ChunkMap map;
+    SkyMap sky;
+} GenJob;
+
+
+// The same steps as gen_job_run in main.c
+static void generate(int p, int q, ChunkMap *map, SkyMap *sky) {
+    chunk_map_alloc(map, p * CHUNK_SIZE, q * CHUNK_SIZE);
+    create_world(p, q, map);
+    sky_alloc(sky, p * CHUNK_SIZE, q * CHUNK_SIZE);
+    sky_compute(sky, map);
+}
+
+static void gen_job_run(Job *job) {
+    GenJob *gen = (GenJob*)job;
+    generate(gen->p, gen->q, &gen->map, &gen->sky);
+}
+
+static int chunk_map_equal(const ChunkMap *a, const ChunkMap *b) {
+    if(a->dx != b->dx || a->dz != b->dz || a->bits != b->bits ||
+       a->palette_size != b->palette_size || a->top != b->top) {
+	return 0;
+    }
+    if(memcmp(a->palette, b->palette, sizeof(a->palette)) ||
+       memcmp(a->edge_height, b->edge_height, sizeof(a->edge_height)) ||
+       memcmp(a->edge_block, b->edge_block, sizeof(a->edge_block))) {
+	return 0;
+    }
+    size_t words = (size_t)CHUNK_VOLUME * a->bits / 64;
+    return !words || !memcmp(a->data, b->data, words * sizeof(uint64_t));
+}
+
+static int sky_equal(const SkyMap *a, const SkyMap *b) {
+    if(memcmp(a->heights, b->heights, SKY_COLUMNS * sizeof(short))) {
+	return 0;
+    }
+    if(a->map.mask != b->map.mask || a->map.size != b->map.size) {
+	return 0;
+    }
+    return !memcmp(a->map.data, b->map.data, (a->map.mask + 1) * sizeof(MapEntry));
+}
+
+int main() {
+    seed(1234);
+    region_init();
+    ChunkMap *maps = (ChunkMap*)calloc(COUNT, sizeof(ChunkMap));
+    SkyMap *skies = (SkyMap*)calloc(COUNT, sizeof(SkyMap));
+    for(int i = 0; i < COUNT; i++) {
+	generate(i / SIZE - RADIUS, i % SIZE - RADIUS, maps + i, skies + i);
+    }
+
+    // Start over with an empty region cache so the workers fill it
+    // between them
+    region_free();
+    region_init();
+    WorkerPool pool;
+    worker_pool_init(&pool, 4);
+    GenJob *jobs = (GenJob*)calloc(COUNT, sizeof(GenJob));
+    for(int i = 0; i < COUNT; i++) {
+	jobs[i].job.func = gen_job_run;
+	jobs[i].p = i / SIZE - RADIUS;
+	jobs[i].q = i % SIZE - RADIUS;
+	worker_pool_submit(&pool, &jobs[i].job);
+    }
+    int done = 0;
+    while(done < COUNT) {
+	Job *job = worker_pool_poll(&pool);
+	if(!job) {
+	    thrd_yield();
+	    continue;
+	}
+	GenJob *gen = (GenJob*)job;
+	int i = (gen->p + RADIUS) * SIZE + gen->q + RADIUS;
+	CHECK(!job->cancelled);
+	CHECK(chunk_map_equal(maps + i, &gen->map));
+	CHECK(sky_equal(skies + i, &gen->sky));
+	chunk_map_free(&gen->map);
+	sky_free(&gen->sky);
+	done++;
+    }
+    CHECK(worker_pool_pending(&pool) == 0);
+    worker_pool_free(&pool);
+
+    for(int i = 0; i < COUNT; i++) {
+	chunk_map_free(maps + i);
+	sky_free(skies + i);
+    }
+    free(maps);
+    free(skies);
+    free(jobs);
+    region_free();
+    return TEST_RESULT;
+}